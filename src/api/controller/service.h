@@ -3,21 +3,30 @@
 
 #include "oatpp/core/macro/codegen.hpp"
 #include "oatpp/core/macro/component.hpp"
+#include "boost/algorithm/string.hpp"
+#include "boost/filesystem.hpp"
 #include "oatpp/web/mime/multipart/InMemoryDataProvider.hpp"
 #include "oatpp/web/mime/multipart/PartList.hpp"
 #include "oatpp/web/mime/multipart/Reader.hpp"
+#include "oatpp/web/mime/multipart/TemporaryFileProvider.hpp"
 #include "oatpp/web/server/api/ApiController.hpp"
 
+#include "api/dto/batch_add_item.h"
+#include "api/dto/batch_multipart.h"
 #include "api/dto/error_response.h"
 #include "api/dto/message_response.h"
 #include "api/dto/new_torrent_response.h"
+#include "api/dto/play_response.h"
+#include "api/dto/removal_status.h"
 #include "api/dto/service_status.h"
 #include "api/dto/torrent_multipart.h"
 #include "bittorrent/exceptions.h"
 #include "torrest.h"
+#include "utils/mime.h"
 #include "utils/utils.h"
 
 #define GET_SERVICE() Torrest::get_instance()->get_service()
+#define MAX_TORRENT_FILE_SIZE (20 * 1024 * 1024)
 
 namespace torrest { namespace api {
 
@@ -53,6 +62,20 @@ public:
         return createDtoResponse(Status::CODE_200, ServiceStatus::create(GET_SERVICE()->get_status()));
     }
 
+    ENDPOINT_INFO(removals) {
+        info->summary = "Removals";
+        info->description = "Get the torrents being removed in the background";
+        info->addResponse<List<Object<RemovalStatus>>>(Status::CODE_200, "application/json");
+    }
+
+    ENDPOINT("GET", "/removals", removals) {
+        auto responseList = List<Object<RemovalStatus>>::createShared();
+        for (const auto &removal : GET_SERVICE()->get_removals()) {
+            responseList->push_back(RemovalStatus::create(removal));
+        }
+        return createDtoResponse(Status::CODE_200, responseList);
+    }
+
     ENDPOINT_INFO(pause) {
         info->summary = "Pause";
         info->description = "Pause the service";
@@ -82,23 +105,38 @@ public:
         info->queryParams["uri"].required = true;
         info->queryParams["download"].description = "Start download after adding magnet";
         info->queryParams["download"].required = false;
+        info->queryParams["memory"].description = "Keep the pieces in memory instead of on disk";
+        info->queryParams["memory"].required = false;
         info->queryParams["ignore_duplicate"].description = "Ignore if duplicate";
         info->queryParams["ignore_duplicate"].required = false;
+        info->queryParams["async"].description = "Return before the torrent is added to the session";
+        info->queryParams["async"].required = false;
         info->addResponse<Object<NewTorrentResponse>>(Status::CODE_200, "application/json");
+        info->addResponse<Object<NewTorrentResponse>>(Status::CODE_202, "application/json");
         info->addResponse<Object<ErrorResponse>>(Status::CODE_400, "application/json");
+        info->addResponse<Object<ErrorResponse>>(Status::CODE_409, "application/json");
         info->addResponse<Object<ErrorResponse>>(Status::CODE_500, "application/json");
     }
 
     ENDPOINT("POST", "/add/magnet", addMagnet,
              QUERY(String, uri, "uri"),
              QUERY(Boolean, download, "download", false),
-             QUERY(Boolean, ignoreDuplicate, "ignore_duplicate", false)) {
+             QUERY(Boolean, memory, "memory", false),
+             QUERY(Boolean, ignoreDuplicate, "ignore_duplicate", false),
+             QUERY(Boolean, async, "async", false)) {
 
         auto magnet = utils::unescape_string(uri);
         OATPP_ASSERT_HTTP(magnet.compare(0, 7, "magnet:") == 0, Status::CODE_400, "Invalid magnet provided")
 
+        if (async) {
+            return handle_duplicate_torrent(
+                    [magnet, download, memory] { return GET_SERVICE()->async_add_magnet(magnet, download, memory); },
+                    ignoreDuplicate, Status::CODE_202);
+        }
+
         return handle_duplicate_torrent(
-                [magnet, download] { return GET_SERVICE()->add_magnet(magnet, download); }, ignoreDuplicate);
+                [magnet, download, memory] { return GET_SERVICE()->add_magnet(magnet, download, memory); },
+                ignoreDuplicate);
     }
 
     ENDPOINT_INFO(addTorrent) {
@@ -106,40 +144,212 @@ public:
         info->description = "Add torrent file to the service";
         info->queryParams["download"].description = "Start download after adding torrent";
         info->queryParams["download"].required = false;
+        info->queryParams["memory"].description = "Keep the pieces in memory instead of on disk";
+        info->queryParams["memory"].required = false;
         info->queryParams["ignore_duplicate"].description = "Ignore if duplicate";
         info->queryParams["ignore_duplicate"].required = false;
+        info->queryParams["async"].description = "Return before the torrent is added to the session";
+        info->queryParams["async"].required = false;
         info->addConsumes<Object<TorrentMultipart>>("multipart/form-data");
         info->addResponse<Object<NewTorrentResponse>>(Status::CODE_200, "application/json");
+        info->addResponse<Object<NewTorrentResponse>>(Status::CODE_202, "application/json");
         info->addResponse<Object<ErrorResponse>>(Status::CODE_400, "application/json");
+        info->addResponse<Object<ErrorResponse>>(Status::CODE_409, "application/json");
         info->addResponse<Object<ErrorResponse>>(Status::CODE_500, "application/json");
     }
 
     ENDPOINT("POST", "/add/torrent", addTorrent,
              REQUEST(std::shared_ptr<IncomingRequest>, request),
              QUERY(Boolean, download, "download", false),
-             QUERY(Boolean, ignoreDuplicate, "ignore_duplicate", false)) {
+             QUERY(Boolean, memory, "memory", false),
+             QUERY(Boolean, ignoreDuplicate, "ignore_duplicate", false),
+             QUERY(Boolean, async, "async", false)) {
 
         auto multipart = std::make_shared<oatpp::web::mime::multipart::PartList>(request->getHeaders());
-        auto memoryReader = oatpp::web::mime::multipart::createInMemoryPartReader(20 * 1024 * 1024);
         oatpp::web::mime::multipart::Reader multipartReader(multipart.get());
-        multipartReader.setPartReader("torrent", memoryReader);
+        multipartReader.setPartReader("torrent", create_torrent_part_reader());
         request->transferBody(&multipartReader);
 
         auto torrent = multipart->getNamedPart("torrent");
         OATPP_ASSERT_HTTP(torrent, Status::CODE_400, "torrent file needs to be provided")
         auto payload = torrent->getPayload();
-        OATPP_ASSERT_HTTP(payload, Status::CODE_400, "torrent file needs to be provided")
+        OATPP_ASSERT_HTTP(payload && payload->getLocation(), Status::CODE_400, "torrent file needs to be provided")
+
+        // The temporary file is kept while the payload is referenced, and removed afterwards
+        std::string location = payload->getLocation();
+        if (async) {
+            return handle_duplicate_torrent(
+                    [location, download, memory] {
+                        return GET_SERVICE()->async_add_torrent_file(location, download, memory);
+                    },
+                    ignoreDuplicate, Status::CODE_202);
+        }
 
         return handle_duplicate_torrent(
-                [payload, download] {
-                    return GET_SERVICE()->add_torrent_data(
-                            payload->getInMemoryData()->c_str(),
-                            int(payload->getInMemoryData()->length()), download);
-                }, ignoreDuplicate);
+                [location, download, memory] { return GET_SERVICE()->add_torrent_file(location, download, memory); },
+                ignoreDuplicate);
+    }
+
+    ENDPOINT_INFO(addBatch) {
+        info->summary = "Add batch";
+        info->description = "Add multiple magnets and torrent files to the service. "
+                            "Torrents are added asynchronously and the result of each item is returned";
+        info->queryParams["download"].description = "Start download after adding torrents";
+        info->queryParams["download"].required = false;
+        info->queryParams["memory"].description = "Keep the pieces in memory instead of on disk";
+        info->queryParams["memory"].required = false;
+        info->queryParams["ignore_duplicate"].description = "Ignore if duplicate";
+        info->queryParams["ignore_duplicate"].required = false;
+        info->addConsumes<Object<BatchMultipart>>("multipart/form-data");
+        info->addResponse<List<Object<BatchAddItem>>>(Status::CODE_202, "application/json");
+        info->addResponse<Object<ErrorResponse>>(Status::CODE_400, "application/json");
+        info->addResponse<Object<ErrorResponse>>(Status::CODE_500, "application/json");
+    }
+
+    ENDPOINT("POST", "/add/batch", addBatch,
+             REQUEST(std::shared_ptr<IncomingRequest>, request),
+             QUERY(Boolean, download, "download", false),
+             QUERY(Boolean, memory, "memory", false),
+             QUERY(Boolean, ignoreDuplicate, "ignore_duplicate", false)) {
+
+        auto multipart = std::make_shared<oatpp::web::mime::multipart::PartList>(request->getHeaders());
+        oatpp::web::mime::multipart::Reader multipartReader(multipart.get());
+        multipartReader.setPartReader("magnet", oatpp::web::mime::multipart::createInMemoryPartReader(64 * 1024));
+        multipartReader.setPartReader("torrent", create_torrent_part_reader());
+        request->transferBody(&multipartReader);
+
+        auto magnets = multipart->getNamedParts("magnet");
+        auto torrents = multipart->getNamedParts("torrent");
+        OATPP_ASSERT_HTTP(!magnets.empty() || !torrents.empty(), Status::CODE_400,
+                          "magnets or torrent files need to be provided")
+
+        auto responseList = List<Object<BatchAddItem>>::createShared();
+
+        for (const auto &part : magnets) {
+            auto payload = part->getPayload();
+            std::string magnet = payload && payload->getInMemoryData() ? *payload->getInMemoryData() : "";
+            responseList->push_back(handle_batch_item(magnet, [magnet, download, memory] {
+                if (magnet.compare(0, 7, "magnet:") != 0) {
+                    throw bittorrent::LoadTorrentException("Invalid magnet provided");
+                }
+                return GET_SERVICE()->async_add_magnet(magnet, download, memory);
+            }, ignoreDuplicate));
+        }
+
+        for (const auto &part : torrents) {
+            auto payload = part->getPayload();
+            responseList->push_back(handle_batch_item(part->getFilename(), [payload, download, memory] {
+                if (!payload || !payload->getLocation()) {
+                    throw bittorrent::LoadTorrentException("Invalid torrent file provided");
+                }
+                return GET_SERVICE()->async_add_torrent_file(payload->getLocation(), download, memory);
+            }, ignoreDuplicate));
+        }
+
+        return createDtoResponse(Status::CODE_202, responseList);
+    }
+
+    ENDPOINT_INFO(play) {
+        info->summary = "Play magnet";
+        info->description = "Add magnet to the service, select its main media file and start buffering it. "
+                            "Returns right away, so the request is repeated until the file is ready to be streamed";
+        info->queryParams["uri"].description = "The magnet URI";
+        info->queryParams["uri"].required = true;
+        info->queryParams["memory"].description = "Keep the pieces in memory instead of on disk";
+        info->queryParams["memory"].required = false;
+        info->addResponse<Object<PlayResponse>>(Status::CODE_200, "application/json");
+        info->addResponse<Object<PlayResponse>>(Status::CODE_202, "application/json");
+        info->addResponse<Object<ErrorResponse>>(Status::CODE_400, "application/json");
+        info->addResponse<Object<ErrorResponse>>(Status::CODE_409, "application/json");
+        info->addResponse<Object<ErrorResponse>>(Status::CODE_500, "application/json");
+    }
+
+    ENDPOINT("POST", "/play", play,
+             QUERY(String, uri, "uri"),
+             QUERY(Boolean, memory, "memory", false)) {
+
+        auto magnet = utils::unescape_string(uri);
+        OATPP_ASSERT_HTTP(magnet.compare(0, 7, "magnet:") == 0, Status::CODE_400, "Invalid magnet provided")
+
+        std::string infoHash;
+        try {
+            infoHash = GET_SERVICE()->async_add_magnet(magnet, false, memory);
+        } catch (const bittorrent::DuplicateTorrentException &e) {
+            infoHash = e.get_info_hash();
+        }
+
+        // Nothing is waited for, so that the worker threads are not held while the torrent is fetched
+        auto torrent = GET_SERVICE()->try_get_torrent(infoHash);
+        if (torrent == nullptr || !torrent->has_metadata()) {
+            return createDtoResponse(Status::CODE_202, PlayResponse::create(infoHash));
+        }
+
+        auto files = torrent->get_files_info();
+        auto &info = files.at(find_media_file(files));
+        auto file = torrent->get_file(info.id);
+
+        // Buffer unless already buffering, so that repeated requests just report the progress. Files already being
+        // downloaded must be buffered as well, as their buffering progress is only tracked while buffering
+        auto status = file->get_status();
+        if (status.state != bittorrent::buffering && status.total_done < status.total) {
+            // Torrents kept in memory are only buffered, as they can't be downloaded
+            if (status.priority == libtorrent::dont_download && !torrent->is_memory_storage()) {
+                file->set_priority(libtorrent::default_priority);
+            }
+            file->buffer(std::max(file->get_size() / 200, Torrest::get_instance()->get_buffer_size()),
+                         10 * 1024 * 1024);
+            status = file->get_status();
+        }
+
+        auto ready = is_playable(status);
+        return createDtoResponse(ready ? Status::CODE_200 : Status::CODE_202,
+                                 PlayResponse::create(infoHash, info, status, ready));
+    }
+
+    static std::size_t find_media_file(const std::vector<bittorrent::FileInfo> &pFiles) {
+        // Prefer the largest video file, then the largest audio file, and fallback to the largest file
+        std::size_t best = 0;
+        int bestRank = -1;
+
+        for (std::size_t i = 0; i < pFiles.size(); i++) {
+            auto rank = utils::is_video_file(pFiles[i].name) ? 2 : utils::is_audio_file(pFiles[i].name) ? 1 : 0;
+
+            if (rank > bestRank || (rank == bestRank && pFiles[i].length > pFiles[best].length)) {
+                best = i;
+                bestRank = rank;
+            }
+        }
+
+        return best;
+    }
+
+    static bool is_playable(const bittorrent::FileStatus &pStatus) {
+        if (pStatus.total_done == pStatus.total) {
+            return true;
+        }
+        switch (pStatus.state) {
+            case bittorrent::downloading:
+            case bittorrent::buffering:
+            case bittorrent::finished:
+            case bittorrent::seeding:
+                return pStatus.buffering_progress >= 100;
+            default:
+                return false;
+        }
+    }
+
+    static std::shared_ptr<oatpp::web::mime::multipart::PartReader> create_torrent_part_reader() {
+        // Stream uploaded torrent files to a temporary file instead of buffering them in memory. The system
+        // temporary directory may be missing or too small on some platforms, so files are staged under the
+        // torrents path, and removed as soon as their payload is released, even if the request fails
+        return oatpp::web::mime::multipart::createTemporaryFilePartReader(
+                GET_SERVICE()->get_uploads_path(), 8, MAX_TORRENT_FILE_SIZE);
     }
 
     std::shared_ptr<OutgoingResponse>
-    handle_duplicate_torrent(const std::function<std::string(void)> &pFun, bool pIgnoreDuplicate) {
+    handle_duplicate_torrent(const std::function<std::string(void)> &pFun,
+                             bool pIgnoreDuplicate,
+                             const Status &pStatus = Status::CODE_200) {
         std::string infoHash;
 
         if (pIgnoreDuplicate) {
@@ -152,7 +362,20 @@ public:
             infoHash = pFun();
         }
 
-        return createDtoResponse(Status::CODE_200, NewTorrentResponse::create(infoHash));
+        return createDtoResponse(pStatus, NewTorrentResponse::create(infoHash));
+    }
+
+    static oatpp::data::mapping::type::DTOWrapper<BatchAddItem>
+    handle_batch_item(const oatpp::String &pSource, const std::function<std::string(void)> &pFun, bool pIgnoreDuplicate) {
+        try {
+            return BatchAddItem::create(pSource, pFun(), nullptr);
+        } catch (const bittorrent::DuplicateTorrentException &e) {
+            return pIgnoreDuplicate
+                   ? BatchAddItem::create(pSource, e.get_info_hash(), nullptr)
+                   : BatchAddItem::create(pSource, e.get_info_hash(), e.what());
+        } catch (const std::exception &e) {
+            return BatchAddItem::create(pSource, nullptr, e.what());
+        }
     }
 };
 
@@ -41,12 +41,18 @@ public:
             responseList->push_back(createTorrentInfoStatus(torrent));
         }
 
+        // Dormant torrents are described from their persisted metadata, so listing them does not activate them
+        for (const auto &dormant: Torrest::get_instance()->get_service()->get_dormant_torrents()) {
+            responseList->push_back(status ? TorrentInfoStatus::create(dormant.info, dormant.status)
+                                           : TorrentInfoStatus::create(dormant.info));
+        }
+
         return createDtoResponse(Status::CODE_200, responseList);
     }
 
     ENDPOINT_INFO(removeTorrent) {
         info->summary = "Remove torrent";
-        info->description = "Remove torrent from service";
+        info->description = "Remove torrent from service. Files are deleted in the background";
         info->pathParams["infoHash"].description = "Torrent info hash";
         info->queryParams["delete"].description = "Delete torrent files";
         info->queryParams["delete"].required = false;
@@ -128,16 +134,17 @@ public:
              PATH(String, infoHash, "infoHash"),
              QUERY(String, prefixEscaped, "prefix", ""),
              QUERY(Boolean, status, "status", false)) {
-        auto files = GET_TORRENT(infoHash)->get_files();
+        auto torrent = GET_TORRENT(infoHash);
+        auto files = torrent->get_files_info();
+        auto statuses = status ? torrent->get_files_status() : std::vector<bittorrent::FileStatus>();
         auto responseList = oatpp::List<Object<FileInfoStatus>>::createShared();
         auto prefix = utils::unescape_string(prefixEscaped);
-        auto createFileInfoStatus = status
-                ? [](const std::shared_ptr<bittorrent::File> &f) { return FileInfoStatus::create(f->get_info(), f->get_status()); }
-                : [](const std::shared_ptr<bittorrent::File> &f) { return FileInfoStatus::create(f->get_info()); };
 
-        for (const auto &file : files) {
-            if (prefix.empty() || file->get_path().rfind(prefix, 0) == 0) {
-                responseList->push_back(createFileInfoStatus(file));
+        for (std::size_t i = 0; i < files.size(); i++) {
+            if (prefix.empty() || files[i].path.rfind(prefix, 0) == 0) {
+                responseList->push_back(status
+                                        ? FileInfoStatus::create(files[i], statuses[i])
+                                        : FileInfoStatus::create(files[i]));
             }
         }
 
@@ -165,9 +172,6 @@ public:
              QUERY(Boolean, status, "status", false)) {
         auto fileInfoList = List<Object<FileInfoStatus>>::createShared();
         auto folderInfoList = List<Object<FolderInfoStatus>>::createShared();
-        auto createFileInfoStatus = status
-                ? [](const std::shared_ptr<bittorrent::File> &f) { return FileInfoStatus::create(f->get_info(), f->get_status()); }
-                : [](const std::shared_ptr<bittorrent::File> &f) { return FileInfoStatus::create(f->get_info()); };
 
         // Normalize the prefix to remove any trailing slash
         boost::filesystem::path prefixPath(utils::unescape_string(prefix));
@@ -175,9 +179,13 @@ public:
             prefixPath.remove_filename();
         }
 
-        auto files = GET_TORRENT(infoHash)->get_files();
-        for (const auto &file : files) {
-            boost::filesystem::path filePath(file->get_path());
+        auto torrent = GET_TORRENT(infoHash);
+        auto files = torrent->get_files_info();
+        auto statuses = status ? torrent->get_files_status() : std::vector<bittorrent::FileStatus>();
+
+        for (std::size_t i = 0; i < files.size(); i++) {
+            auto &file = files[i];
+            boost::filesystem::path filePath(file.path);
 
             // Check if filePath starts with prefix
             auto mismatch = std::mismatch(prefixPath.begin(), prefixPath.end(),
@@ -190,7 +198,9 @@ public:
 
                 if (numComponents == 1) {
                     // If there's only one component, it's a file at the prefix level
-                    fileInfoList->push_back(createFileInfoStatus(file));
+                    fileInfoList->push_back(status
+                                            ? FileInfoStatus::create(file, statuses[i])
+                                            : FileInfoStatus::create(file));
                 } else if (numComponents > 1) {
                     // If there are more than one component, add the first component as a directory
                     auto folderName = *mismatch.second;
@@ -207,11 +217,11 @@ public:
                         auto folderInfoStatus = FolderInfoStatus::createShared();
                         folderInfoStatus->name = folderName.string();
                         folderInfoStatus->path = folderPath.string();
-                        folderInfoStatus->length = file->get_size();
+                        folderInfoStatus->length = file.length;
                         folderInfoStatus->file_count = 1;
 
                         if (status) {
-                            auto fileStatus = file->get_status();
+                            auto &fileStatus = statuses[i];
                             folderInfoStatus->status = FolderStatus::createShared();
                             folderInfoStatus->status->total = fileStatus.total;
                             folderInfoStatus->status->total_done = fileStatus.total_done;
@@ -229,11 +239,11 @@ public:
 
                         folderInfoList->push_back(folderInfoStatus);
                     } else {
-                        (*it)->length = (*it)->length + file->get_size();
+                        (*it)->length = (*it)->length + file.length;
                         (*it)->file_count = (*it)->file_count + 1;
 
                         if (status) {
-                            auto fileStatus = file->get_status();
+                            auto &fileStatus = statuses[i];
                             (*it)->status->total = (*it)->status->total + fileStatus.total;
                             (*it)->status->total_done = (*it)->status->total_done + fileStatus.total_done;
 
@@ -267,6 +277,7 @@ public:
         info->queryParams["prefix"].description = "Download files by prefix";
         info->queryParams["prefix"].required = false;
         info->addResponse<Object<MessageResponse>>(Status::CODE_200, "application/json");
+        info->addResponse<Object<ErrorResponse>>(Status::CODE_400, "application/json");
         info->addResponse<Object<ErrorResponse>>(Status::CODE_404, "application/json");
         info->addResponse<Object<ErrorResponse>>(Status::CODE_500, "application/json");
     }
@@ -300,20 +311,8 @@ public:
                                                    const std::string &successMessage) {
         if (prefix.empty()) {
             GET_TORRENT(infoHash)->set_priority(priority);
-        } else {
-            bool isDownloading = false;
-            auto files = GET_TORRENT(infoHash)->get_files();
-
-            for (const auto &file : files) {
-                if (file->get_path().rfind(prefix, 0) == 0) {
-                    file->set_priority(priority);
-                    isDownloading = true;
-                }
-            }
-
-            if (!isDownloading) {
-                return createDtoResponse(Status::CODE_404, ErrorResponse::create("Invalid prefix provided"));
-            }
+        } else if (GET_TORRENT(infoHash)->set_priority(priority, prefix) == 0) {
+            return createDtoResponse(Status::CODE_404, ErrorResponse::create("Invalid prefix provided"));
         }
 
         return createDtoResponse(Status::CODE_200, MessageResponse::create(successMessage));
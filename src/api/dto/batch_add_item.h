@@ -0,0 +1,32 @@
+#ifndef TORREST_BATCH_ADD_ITEM_H
+#define TORREST_BATCH_ADD_ITEM_H
+
+#include "api/dto/utils.h"
+
+namespace torrest { namespace api {
+
+#include OATPP_CODEGEN_BEGIN(DTO)
+
+class BatchAddItem : public oatpp::DTO {
+    DTO_INIT(BatchAddItem, DTO)
+
+    FIELD(String, source, "The magnet URI or torrent file name")
+    FIELD(String, info_hash, "The torrent info hash")
+    FIELD(String, error, "Error message, if the torrent could not be added")
+
+    static oatpp::data::mapping::type::DTOWrapper<BatchAddItem> create(const oatpp::String &pSource,
+                                                                       const oatpp::String &pInfoHash,
+                                                                       const oatpp::String &pError) {
+        auto item = BatchAddItem::createShared();
+        item->source = pSource;
+        item->info_hash = pInfoHash;
+        item->error = pError;
+        return item;
+    }
+};
+
+#include OATPP_CODEGEN_END(DTO)
+
+}}
+
+#endif //TORREST_BATCH_ADD_ITEM_H
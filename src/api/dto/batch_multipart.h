@@ -0,0 +1,21 @@
+#ifndef TORREST_BATCH_MULTIPART_H
+#define TORREST_BATCH_MULTIPART_H
+
+#include "api/dto/utils.h"
+
+namespace torrest { namespace api {
+
+#include OATPP_CODEGEN_BEGIN(DTO)
+
+class BatchMultipart : public oatpp::DTO {
+    DTO_INIT(BatchMultipart, DTO)
+
+    FIELD(List<String>, magnet, "The magnet URIs");
+    FIELD(List<Binary>, torrent, "The torrent files");
+};
+
+#include OATPP_CODEGEN_END(DTO)
+
+}}
+
+#endif //TORREST_BATCH_MULTIPART_H
@@ -0,0 +1,47 @@
+#ifndef TORREST_PLAY_RESPONSE_H
+#define TORREST_PLAY_RESPONSE_H
+
+#include "api/dto/file_info_status.h"
+#include "api/dto/utils.h"
+
+namespace torrest { namespace api {
+
+#include OATPP_CODEGEN_BEGIN(DTO)
+
+class PlayResponse : public oatpp::DTO {
+    DTO_INIT(PlayResponse, DTO)
+
+    FIELD(String, info_hash, "The torrent info hash")
+
+    FIELD(Boolean, ready, "Flag indicating if the file is ready to be streamed")
+
+    FIELD(Object<FileInfoStatus>, file, "The file selected for playback, once the torrent metadata is available")
+
+    FIELD(String, url, "The path to stream the selected file from")
+
+    static oatpp::data::mapping::type::DTOWrapper<PlayResponse> create(const std::string &pInfoHash) {
+        auto response = PlayResponse::createShared();
+        response->info_hash = pInfoHash;
+        response->ready = false;
+        response->file = nullptr;
+        response->url = nullptr;
+        return response;
+    }
+
+    static oatpp::data::mapping::type::DTOWrapper<PlayResponse> create(const std::string &pInfoHash,
+                                                                       const bittorrent::FileInfo &pInfo,
+                                                                       const bittorrent::FileStatus &pStatus,
+                                                                       bool pReady) {
+        auto response = create(pInfoHash);
+        response->ready = pReady;
+        response->file = FileInfoStatus::create(pInfo, pStatus);
+        response->url = "/torrents/" + pInfoHash + "/files/" + std::to_string(pInfo.id) + "/serve";
+        return response;
+    }
+};
+
+#include OATPP_CODEGEN_END(DTO)
+
+}}
+
+#endif //TORREST_PLAY_RESPONSE_H
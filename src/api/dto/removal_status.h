@@ -0,0 +1,50 @@
+#ifndef TORREST_REMOVAL_STATUS_H
+#define TORREST_REMOVAL_STATUS_H
+
+#include "api/dto/utils.h"
+#include "bittorrent/service.h"
+
+namespace torrest { namespace api {
+
+#include OATPP_CODEGEN_BEGIN(DTO)
+
+class RemovalStatus : public oatpp::DTO {
+    DTO_INIT(RemovalStatus, DTO)
+
+    FIELD(String, info_hash, "The torrent info hash")
+
+    FIELD(String, name, "The torrent name")
+
+    FIELD(Boolean, delete_files, "Flag indicating if the torrent files are being deleted")
+
+    FIELD(Boolean, failed, "Flag indicating if deleting the torrent files failed")
+
+    FIELD(String, error, "Error message, if deleting the torrent files failed")
+
+    FIELD(Int32, state, "State of the removal (0: removing, 1: deleting files, 2: failed)")
+
+    FIELD(Int64, size, "Size of the torrent files being deleted")
+
+    FIELD(Int64, elapsed_time, "Time elapsed since the removal started, in seconds")
+
+    static oatpp::data::mapping::type::DTOWrapper<RemovalStatus> create(const bittorrent::RemovalStatus &pStatus) {
+        auto status = RemovalStatus::createShared();
+        status->info_hash = pStatus.info_hash;
+        status->name = pStatus.name;
+        status->delete_files = pStatus.delete_files;
+        status->failed = pStatus.failed;
+        status->state = pStatus.state;
+        status->size = pStatus.size;
+        status->elapsed_time = pStatus.elapsed_time;
+        if (pStatus.failed) {
+            status->error = pStatus.error;
+        }
+        return status;
+    }
+};
+
+#include OATPP_CODEGEN_END(DTO)
+
+}}
+
+#endif //TORREST_REMOVAL_STATUS_H
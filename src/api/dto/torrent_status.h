@@ -49,6 +49,12 @@ class TorrentStatus : public oatpp::DTO {
 
     FIELD(Int64, all_time_upload, "All time upload (seconds)")
 
+    FIELD(Int32, deadline_hits, "Number of streamed pieces downloaded in time")
+
+    FIELD(Int32, deadline_misses, "Number of streamed pieces downloaded late")
+
+    FIELD(Float64, deadline_hit_ratio, "Percentage of streamed pieces downloaded in time")
+
     static oatpp::data::mapping::type::DTOWrapper<TorrentStatus> create(const bittorrent::TorrentStatus &pStatus) {
         auto status = TorrentStatus::createShared();
         status->total = pStatus.total;
@@ -70,6 +76,9 @@ class TorrentStatus : public oatpp::DTO {
         status->active_time = pStatus.active_time;
         status->all_time_download = pStatus.all_time_download;
         status->all_time_upload = pStatus.all_time_upload;
+        status->deadline_hits = pStatus.deadline_hits;
+        status->deadline_misses = pStatus.deadline_misses;
+        status->deadline_hit_ratio = pStatus.deadline_hit_ratio;
         return status;
     }
 };
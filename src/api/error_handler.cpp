@@ -34,6 +34,10 @@ namespace torrest { namespace api {
                 status = oatpp::web::protocol::http::Status::CODE_404;
             } catch (const bittorrent::InvalidFileIndexException &e) {
                 status = oatpp::web::protocol::http::Status::CODE_404;
+            } catch (const bittorrent::TorrentRemovalException &e) {
+                status = oatpp::web::protocol::http::Status::CODE_409;
+            } catch (const bittorrent::MemoryStorageException &e) {
+                status = oatpp::web::protocol::http::Status::CODE_400;
             } catch (const range_parser::RangeException &e) {
                 status = oatpp::web::protocol::http::Status::CODE_416;
             } catch (...) {
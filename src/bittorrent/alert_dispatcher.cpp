@@ -0,0 +1,18 @@
+#include "alert_dispatcher.h"
+
+namespace torrest { namespace bittorrent {
+
+    bool AlertDispatcher::has_subscribers(int pType) const {
+        return pType >= 0 && pType < int(mHandlers.size()) && !mHandlers[pType].empty();
+    }
+
+    void AlertDispatcher::dispatch(const libtorrent::alert *pAlert) const {
+        auto type = pAlert->type();
+        if (has_subscribers(type)) {
+            for (auto &handler : mHandlers[type]) {
+                handler(pAlert);
+            }
+        }
+    }
+
+}}
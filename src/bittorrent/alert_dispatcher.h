@@ -0,0 +1,38 @@
+#ifndef TORREST_ALERT_DISPATCHER_H
+#define TORREST_ALERT_DISPATCHER_H
+
+#include <array>
+#include <functional>
+#include <vector>
+
+#include "libtorrent/alert.hpp"
+#include "libtorrent/alert_types.hpp"
+
+namespace torrest { namespace bittorrent {
+
+    /**
+     * Dispatch table indexed by alert type. Subscribers must be registered before
+     * alerts start being dispatched, as dispatching is not synchronized.
+     */
+    class AlertDispatcher {
+    public:
+        typedef std::function<void(const libtorrent::alert *)> AlertHandler;
+
+        template<typename T>
+        void subscribe(std::function<void(const T *)> pHandler) {
+            mHandlers.at(T::alert_type).emplace_back([pHandler](const libtorrent::alert *pAlert) {
+                pHandler(static_cast<const T *>(pAlert));
+            });
+        }
+
+        bool has_subscribers(int pType) const;
+
+        void dispatch(const libtorrent::alert *pAlert) const;
+
+    private:
+        std::array<std::vector<AlertHandler>, libtorrent::num_alert_types> mHandlers;
+    };
+
+}}
+
+#endif //TORREST_ALERT_DISPATCHER_H
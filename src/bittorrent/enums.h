@@ -25,6 +25,19 @@ namespace torrest { namespace bittorrent {
         buffering
     };
 
+    enum BandwidthClass {
+        bc_streaming,
+        bc_buffering,
+        bc_background,
+        bc_seeding
+    };
+
+    enum RemovalState {
+        rs_removing,
+        rs_deleting_files,
+        rs_failed
+    };
+
 }}
 
 #endif //TORREST_ENUMS_H
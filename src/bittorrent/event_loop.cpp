@@ -0,0 +1,107 @@
+#include "event_loop.h"
+
+namespace torrest { namespace bittorrent {
+
+    EventLoop::EventLoop(std::shared_ptr<spdlog::logger> pLogger)
+            : mLogger(std::move(pLogger)),
+              mNotified(false),
+              mIsRunning(false) {}
+
+    EventLoop::~EventLoop() {
+        stop();
+    }
+
+    void EventLoop::set_event_handler(Task pHandler) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mEventHandler = std::move(pHandler);
+    }
+
+    void EventLoop::schedule(std::string pName, Interval pInterval, Task pTask) {
+        mLogger->debug("operation=schedule, name={}", pName);
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto deadline = std::chrono::steady_clock::now() + pInterval();
+        mTasks.push_back(ScheduledTask{std::move(pName), std::move(pInterval), std::move(pTask)});
+        mTimers.push(Timer{deadline, mTasks.size() - 1});
+        mCv.notify_one();
+    }
+
+    void EventLoop::start() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (!mIsRunning) {
+            mIsRunning = true;
+            mThread = std::thread(&EventLoop::run, this);
+        }
+    }
+
+    void EventLoop::stop() {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mIsRunning = false;
+        }
+        mCv.notify_all();
+        if (mThread.joinable()) {
+            mThread.join();
+        }
+    }
+
+    void EventLoop::notify() {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mNotified = true;
+        }
+        mCv.notify_one();
+    }
+
+    void EventLoop::run() {
+        mLogger->debug("operation=run, message='Initializing event loop'");
+        std::unique_lock<std::mutex> lock(mMutex);
+
+        while (mIsRunning) {
+            if (mNotified) {
+                mNotified = false;
+                auto handler = mEventHandler;
+                lock.unlock();
+                run_task("event_handler", handler);
+                lock.lock();
+            }
+
+            // Run every task due after each events batch, so that a steady stream of events never starves them
+            auto now = std::chrono::steady_clock::now();
+            while (mIsRunning && !mTimers.empty() && mTimers.top().deadline <= now) {
+                auto timer = mTimers.top();
+                mTimers.pop();
+                auto scheduledTask = mTasks[timer.task];
+                lock.unlock();
+                run_task(scheduledTask.name, scheduledTask.task);
+                auto deadline = std::chrono::steady_clock::now() + scheduledTask.interval();
+                lock.lock();
+                mTimers.push(Timer{deadline, timer.task});
+            }
+
+            if (!mIsRunning || mNotified) {
+                continue;
+            }
+
+            if (mTimers.empty()) {
+                mCv.wait(lock);
+            } else {
+                mCv.wait_until(lock, mTimers.top().deadline);
+            }
+        }
+
+        mLogger->debug("operation=run, message='Terminating event loop'");
+    }
+
+    void EventLoop::run_task(const std::string &pName, const Task &pTask) const {
+        if (!pTask) {
+            return;
+        }
+
+        try {
+            pTask();
+        } catch (const std::exception &e) {
+            mLogger->error("operation=run_task, message='Failed running task', name={}, what='{}'", pName, e.what());
+        }
+    }
+
+}}
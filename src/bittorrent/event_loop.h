@@ -0,0 +1,77 @@
+#ifndef TORREST_EVENT_LOOP_H
+#define TORREST_EVENT_LOOP_H
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "spdlog/spdlog.h"
+
+namespace torrest { namespace bittorrent {
+
+    /**
+     * Single threaded event loop. It runs the event handler whenever notify() is called and
+     * the scheduled tasks whenever their interval elapses, sleeping in between.
+     */
+    class EventLoop {
+    public:
+        typedef std::function<void()> Task;
+        typedef std::function<std::chrono::milliseconds()> Interval;
+
+        explicit EventLoop(std::shared_ptr<spdlog::logger> pLogger);
+
+        ~EventLoop();
+
+        void set_event_handler(Task pHandler);
+
+        void schedule(std::string pName, Interval pInterval, Task pTask);
+
+        void start();
+
+        void stop();
+
+        void notify();
+
+        EventLoop(EventLoop const &) = delete;
+
+        void operator=(EventLoop const &) = delete;
+
+    private:
+        struct ScheduledTask {
+            std::string name;
+            Interval interval;
+            Task task;
+        };
+
+        struct Timer {
+            std::chrono::steady_clock::time_point deadline;
+            std::size_t task;
+
+            bool operator>(const Timer &pOther) const {
+                return deadline > pOther.deadline;
+            }
+        };
+
+        void run();
+
+        void run_task(const std::string &pName, const Task &pTask) const;
+
+        std::shared_ptr<spdlog::logger> mLogger;
+        Task mEventHandler;
+        std::vector<ScheduledTask> mTasks;
+        std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> mTimers;
+        std::mutex mMutex;
+        std::condition_variable mCv;
+        bool mNotified;
+        bool mIsRunning;
+        std::thread mThread;
+    };
+
+}}
+
+#endif //TORREST_EVENT_LOOP_H
@@ -37,10 +37,28 @@ namespace torrest { namespace bittorrent {
         std::string mInfoHash;
     };
 
+    class TorrentRemovalException : public BittorrentException {
+    public:
+        TorrentRemovalException(const char *pMessage, std::string pInfoHash)
+                : BittorrentException(pMessage),
+                  mInfoHash(std::move(pInfoHash)) {}
+
+        const std::string &get_info_hash() const {
+            return mInfoHash;
+        }
+
+    private:
+        std::string mInfoHash;
+    };
+
     class LoadTorrentException : public BittorrentException {
         using BittorrentException::BittorrentException;
     };
 
+    class MemoryStorageException : public BittorrentException {
+        using BittorrentException::BittorrentException;
+    };
+
     class ReaderException : public BittorrentException {
         using BittorrentException::BittorrentException;
     };
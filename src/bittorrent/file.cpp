@@ -1,34 +1,35 @@
 #include "file.h"
 
 #include "exceptions.h"
+#include "file_table.h"
+#include "memory_storage.h"
 #include "reader.h"
 #include "settings.h"
 #include "torrent.h"
+#include "utils/mime.h"
 
 #define CHECK_TORRENT(t) do { if (!t) throw torrest::bittorrent::InvalidTorrentException("Invalid torrent"); } while(0)
 
 namespace torrest { namespace bittorrent {
 
     File::File(const std::shared_ptr<Torrent> &pTorrent,
-               const libtorrent::file_storage &pFileStorage,
+               std::shared_ptr<const FileTable> pFileTable,
                libtorrent::file_index_t pIndex)
             : mTorrent(pTorrent),
               mLogger(pTorrent->mLogger),
+              mFileTable(std::move(pFileTable)),
               mIndex(pIndex),
-              mOffset(pFileStorage.file_offset(pIndex)),
-              mSize(pFileStorage.file_size(pIndex)),
-              mPath(pFileStorage.file_path(pIndex)),
-              mName(pFileStorage.file_name(pIndex)),
-              mPieceLength(pFileStorage.piece_length()),
+              mOffset(mFileTable->file_offset(int(pIndex))),
+              mSize(mFileTable->file_size(int(pIndex))),
+              mPath(mFileTable->file_path(int(pIndex))),
+              mName(mFileTable->file_name(int(pIndex))),
+              mPieceLength(mFileTable->piece_length()),
               mPriority(pTorrent->mHandle.file_priority(pIndex)),
               mBuffering(false),
-              mBufferSize(0) {
-        if (mPriority.load() == libtorrent::dont_download) {
-            // Make sure we don't have individual pieces downloading
-            // previously set by Buffer
-            set_priority(libtorrent::dont_download);
-        }
-    }
+              mBufferSize(0),
+              mBufferBytesMissing(0),
+              mBufferBytesPartial(0),
+              mBufferResync(false) {}
 
     FileInfo File::get_info() const {
         mLogger->trace("operation=get_info");
@@ -42,32 +43,55 @@ namespace torrest { namespace bittorrent {
 
     FileStatus File::get_status() const {
         mLogger->trace("operation=get_status");
+        auto torrent = mTorrent.lock();
+        CHECK_TORRENT(torrent);
+        return get_status(torrent->get_torrent_state(), get_completed());
+    }
+
+    FileStatus File::get_status(State pTorrentState, std::int64_t pCompleted) const {
         std::lock_guard<std::mutex> lock(mMutex);
-        auto completed = get_completed();
         return FileStatus{
                 .total=mSize,
-                .total_done=completed,
-                .progress=get_progress(completed),
+                .total_done=pCompleted,
+                .progress=get_progress(pCompleted, mSize),
                 .priority=std::uint8_t(mPriority.load()),
                 .buffering_total=mBufferSize,
                 .buffering_progress=get_buffering_progress(),
-                .state=get_state(completed),
+                .state=get_state(pTorrentState, mBuffering.load(), mPriority.load(), pCompleted, mSize),
         };
     }
 
     void File::set_priority(libtorrent::download_priority_t pPriority) {
         auto torrent = mTorrent.lock();
         CHECK_TORRENT(torrent);
+        torrent->check_download_allowed(pPriority);
 
         mLogger->debug("operation=set_priority, message='Setting file priority', priority={}, infoHash={}, index={}",
                        to_string(pPriority), torrent->mInfoHash, to_string(mIndex));
-        std::lock_guard<std::mutex> lock(mMutex);
+        reset_priority(pPriority);
+        torrent->mHandle.file_priority(mIndex, pPriority);
+        torrent->mResumeDataDirty = true;
+    }
 
+    void File::reset_priority(libtorrent::download_priority_t pPriority) {
+        std::lock_guard<std::mutex> lock(mMutex);
         mPriority = pPriority;
         mBuffering = false;
         mBufferSize = 0;
         mBufferPieces.clear();
-        torrent->mHandle.file_priority(mIndex, pPriority);
+        mBufferMissing.clear();
+        mBufferPartialBytes.clear();
+        mBufferBytesMissing = 0;
+        mBufferBytesPartial = 0;
+
+        auto torrent = mTorrent.lock();
+        if (!torrent) {
+            return;
+        }
+        torrent->remove_deadline_windows(this);
+        if (torrent->mMemoryBuffer != nullptr) {
+            torrent->mMemoryBuffer->set_protected_pieces(this, {});
+        }
     }
 
     std::int64_t File::get_completed() const {
@@ -80,21 +104,20 @@ namespace torrest { namespace bittorrent {
         return file_progress.at(int(mIndex));
     }
 
-    double File::get_progress(std::int64_t pCompleted) const {
-        mLogger->trace("operation=get_progress, completed={}", pCompleted);
-        return 100.0 * static_cast<double>(pCompleted) / static_cast<double>(mSize);
+    double File::get_progress(std::int64_t pCompleted, std::int64_t pSize) {
+        return 100.0 * static_cast<double>(pCompleted) / static_cast<double>(pSize);
     }
 
-    State File::get_state(std::int64_t pCompleted) const {
-        mLogger->trace("operation=get_state, completed={}", pCompleted);
-        auto torrent = mTorrent.lock();
-        CHECK_TORRENT(torrent);
-
-        auto state = torrent->get_torrent_state();
+    State File::get_state(State pTorrentState,
+                          bool pBuffering,
+                          libtorrent::download_priority_t pPriority,
+                          std::int64_t pCompleted,
+                          std::int64_t pSize) {
+        auto state = pTorrentState;
         if (state == downloading) {
-            if (mBuffering.load()) {
+            if (pBuffering) {
                 state = buffering;
-            } else if (mPriority.load() == libtorrent::dont_download || pCompleted == mSize) {
+            } else if (pPriority == libtorrent::dont_download || pCompleted == pSize) {
                 state = finished;
             }
         }
@@ -104,9 +127,7 @@ namespace torrest { namespace bittorrent {
 
     std::int64_t File::get_buffer_bytes_missing() const {
         mLogger->trace("operation=get_buffer_bytes_missing");
-        auto torrent = mTorrent.lock();
-        CHECK_TORRENT(torrent);
-        return torrent->get_bytes_missing(mBufferPieces);
+        return std::max<std::int64_t>(mBufferBytesMissing - mBufferBytesPartial, 0);
     }
 
     std::int64_t File::get_buffer_bytes_completed() const {
@@ -125,8 +146,13 @@ namespace torrest { namespace bittorrent {
 
         if (mBuffering.load()) {
             std::lock_guard<std::mutex> lock(mMutex);
+            if (mBuffering.load() && mBufferResync.exchange(false)) {
+                auto torrent = mTorrent.lock();
+                CHECK_TORRENT(torrent);
+                sync_buffer_progress(torrent);
+            }
             if (mBuffering.load()) {
-                if (get_buffer_bytes_missing() == 0) {
+                if (mBufferBytesMissing == 0) {
                     mBuffering = false;
                 } else {
                     buffering = true;
@@ -137,6 +163,87 @@ namespace torrest { namespace bittorrent {
         return buffering;
     }
 
+    void File::sync_buffer_progress(const std::shared_ptr<Torrent> &pTorrent) {
+        mLogger->trace("operation=sync_buffer_progress, index={}", to_string(mIndex));
+        auto status = pTorrent->mHandle.status(libtorrent::torrent_handle::query_pieces);
+
+        mBufferMissing.assign(mFileTable->num_pieces(), false);
+        mBufferPartialBytes.clear();
+        mBufferBytesMissing = 0;
+        mBufferBytesPartial = 0;
+
+        for (auto &piece : mBufferPieces) {
+            if (status.is_seeding || (!status.pieces.empty() && status.pieces.get_bit(piece))) {
+                continue;
+            }
+            mBufferMissing[int(piece)] = true;
+            mBufferBytesMissing += mFileTable->piece_size(int(piece));
+        }
+
+        if (mBufferBytesMissing > 0) {
+            std::vector<libtorrent::partial_piece_info> queue;
+            pTorrent->mHandle.get_download_queue(queue);
+
+            for (auto &qPiece : queue) {
+                if (is_buffer_piece_missing(qPiece.piece_index)) {
+                    std::int64_t bytes = 0;
+                    for (int i = 0; i < qPiece.blocks_in_piece; i++) {
+                        bytes += qPiece.blocks[i].bytes_progress;
+                    }
+                    mBufferPartialBytes[int(qPiece.piece_index)] = bytes;
+                    mBufferBytesPartial += bytes;
+                }
+            }
+        }
+    }
+
+    bool File::is_buffer_piece_missing(libtorrent::piece_index_t pPiece) const {
+        auto index = static_cast<std::size_t>(int(pPiece));
+        return index < mBufferMissing.size() && mBufferMissing[index];
+    }
+
+    void File::handle_piece_finished(libtorrent::piece_index_t pPiece) {
+        if (!mBuffering.load()) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (is_buffer_piece_missing(pPiece)) {
+            mBufferMissing[int(pPiece)] = false;
+            mBufferBytesMissing -= mFileTable->piece_size(int(pPiece));
+            auto it = mBufferPartialBytes.find(int(pPiece));
+            if (it != mBufferPartialBytes.end()) {
+                mBufferBytesPartial -= it->second;
+                mBufferPartialBytes.erase(it);
+            }
+        }
+    }
+
+    void File::handle_block_finished(libtorrent::piece_index_t pPiece, int pBlockSize) {
+        if (!mBuffering.load()) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (is_buffer_piece_missing(pPiece)) {
+            auto &bytes = mBufferPartialBytes[int(pPiece)];
+            // Blocks may be received more than once, so never count more than the piece size
+            auto added = std::min<std::int64_t>(pBlockSize, mFileTable->piece_size(int(pPiece)) - bytes);
+            bytes += added;
+            mBufferBytesPartial += added;
+        }
+    }
+
+    void File::handle_hash_failed(libtorrent::piece_index_t pPiece) {
+        if (!mBuffering.load()) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto it = mBufferPartialBytes.find(int(pPiece));
+        if (it != mBufferPartialBytes.end()) {
+            mBufferBytesPartial -= it->second;
+            mBufferPartialBytes.erase(it);
+        }
+    }
+
     std::pair<libtorrent::piece_index_t, libtorrent::piece_index_t>
     File::get_pieces_indexes(std::int64_t pOffset, std::int64_t pLength) const {
         mLogger->trace("operation=get_pieces_indexes, index={}, offset={}, length={}",
@@ -148,15 +255,14 @@ namespace torrest { namespace bittorrent {
     void File::add_buffer_pieces(std::int64_t pOffset, std::int64_t pLength) {
         mLogger->trace("operation=add_buffer_pieces, index={}, offset={}, length={}",
                        to_string(mIndex), pOffset, pLength);
-        auto torrent = mTorrent.lock();
-        CHECK_TORRENT(torrent);
-        auto torrent_file = torrent->mHandle.torrent_file();
         auto pieces = get_pieces_indexes(pOffset, pLength);
 
         for (auto piece = pieces.first; piece <= pieces.second; piece++) {
-            torrent->mHandle.piece_priority(piece, libtorrent::top_priority);
-            torrent->mHandle.set_piece_deadline(piece, 0);
-            mBufferSize += torrent_file->piece_size(piece);
+            // The start and end buffers may share a piece
+            if (!mBufferPieces.empty() && piece <= mBufferPieces.back()) {
+                continue;
+            }
+            mBufferSize += mFileTable->piece_size(int(piece));
             mBufferPieces.push_back(piece);
         }
     }
@@ -168,6 +274,12 @@ namespace torrest { namespace bittorrent {
         auto start_buffer_size = std::max<std::int64_t>(pStartBufferSize, 0);
         auto end_buffer_size = std::max<std::int64_t>(pEndBufferSize, 0);
 
+        auto torrent = mTorrent.lock();
+        CHECK_TORRENT(torrent);
+        if (utils::is_video_file(mName)) {
+            torrent->prefetch_companion_files(int(mIndex));
+        }
+
         std::lock_guard<std::mutex> lock(mMutex);
 
         mBufferSize = 0;
@@ -180,6 +292,41 @@ namespace torrest { namespace bittorrent {
             add_buffer_pieces(0, mSize);
         }
 
+        // Prioritize all buffer pieces with a single call
+        std::vector<std::pair<libtorrent::piece_index_t, libtorrent::download_priority_t>> priorities;
+        priorities.reserve(mBufferPieces.size());
+        for (auto &piece : mBufferPieces) {
+            priorities.emplace_back(piece, libtorrent::top_priority);
+        }
+        torrent->mHandle.prioritize_pieces(priorities);
+
+        // Buffer pieces are tracked as deadline pieces, so they are escalated when late like reader pieces
+        std::vector<std::pair<int, int>> windows;
+        for (auto &piece : mBufferPieces) {
+            if (!windows.empty() && windows.back().second == int(piece) - 1) {
+                windows.back().second = int(piece);
+            } else {
+                windows.emplace_back(int(piece), int(piece));
+            }
+        }
+        torrent->set_deadline_windows(this, std::move(windows));
+        for (auto &piece : mBufferPieces) {
+            torrent->set_piece_deadline(piece, 0);
+        }
+
+        // Buffered pieces kept in memory must still be there when read
+        if (torrent->mMemoryBuffer != nullptr) {
+            std::vector<int> protectedPieces;
+            protectedPieces.reserve(mBufferPieces.size());
+            for (auto &piece : mBufferPieces) {
+                protectedPieces.push_back(int(piece));
+            }
+            torrent->mMemoryBuffer->set_protected_pieces(this, std::move(protectedPieces));
+        }
+
+        // From now on the buffer progress is updated from the piece and block alerts
+        sync_buffer_progress(torrent);
+        mBufferResync = false;
         mBuffering = mBufferSize > 0;
     }
 
@@ -187,8 +334,17 @@ namespace torrest { namespace bittorrent {
         mLogger->debug("operation=reader, index={}, readAhead={}", to_string(mIndex), pReadAhead);
         auto torrent = mTorrent.lock();
         CHECK_TORRENT(torrent);
-        return std::make_shared<Reader>(
-                torrent, mOffset, mSize, mPieceLength, pReadAhead, torrent->mSettings->get_piece_wait_timeout());
+        auto settings = torrent->mSettings->load();
+        auto isVideo = utils::is_video_file(mName);
+        if (isVideo) {
+            torrent->prefetch_companion_files(int(mIndex));
+        }
+
+        // The next file is prefetched once a video is read past the configured fraction
+        auto prefetchOffset = settings->prefetch_next_file > 0 && isVideo
+                              ? mSize * settings->prefetch_next_file / 100 : -1;
+        return std::make_shared<Reader>(torrent, int(mIndex), mOffset, mSize, mPieceLength, pReadAhead,
+                                        settings->sequential_window, prefetchOffset, settings->piece_wait_timeout);
     }
 
 }}
@@ -3,9 +3,9 @@
 
 #include <atomic>
 #include <mutex>
+#include <unordered_map>
 
 #include "libtorrent/download_priority.hpp"
-#include "libtorrent/file_storage.hpp"
 #include "libtorrent/torrent_info.hpp"
 #include "spdlog/spdlog.h"
 
@@ -36,7 +36,7 @@ namespace torrest { namespace bittorrent {
 
     public:
         File(const std::shared_ptr<Torrent> &pTorrent,
-             const libtorrent::file_storage &pFileStorage,
+             std::shared_ptr<const FileTable> pFileTable,
              libtorrent::file_index_t pIndex);
 
         std::int64_t get_size() const { return mSize; }
@@ -73,12 +73,31 @@ namespace torrest { namespace bittorrent {
 
         bool verify_buffering_state();
 
-        State get_state(std::int64_t pCompleted) const;
+        void sync_buffer_progress(const std::shared_ptr<Torrent> &pTorrent);
 
-        double get_progress(std::int64_t pCompleted) const;
+        bool is_buffer_piece_missing(libtorrent::piece_index_t pPiece) const;
+
+        void handle_piece_finished(libtorrent::piece_index_t pPiece);
+
+        void handle_block_finished(libtorrent::piece_index_t pPiece, int pBlockSize);
+
+        void handle_hash_failed(libtorrent::piece_index_t pPiece);
+
+        void reset_priority(libtorrent::download_priority_t pPriority);
+
+        FileStatus get_status(State pTorrentState, std::int64_t pCompleted) const;
+
+        static State get_state(State pTorrentState,
+                               bool pBuffering,
+                               libtorrent::download_priority_t pPriority,
+                               std::int64_t pCompleted,
+                               std::int64_t pSize);
+
+        static double get_progress(std::int64_t pCompleted, std::int64_t pSize);
 
         std::weak_ptr<Torrent> mTorrent;
         std::shared_ptr<spdlog::logger> mLogger;
+        std::shared_ptr<const FileTable> mFileTable;
         libtorrent::file_index_t mIndex;
         std::int64_t mOffset;
         std::int64_t mSize;
@@ -89,7 +108,12 @@ namespace torrest { namespace bittorrent {
         std::atomic<libtorrent::download_priority_t> mPriority;
         std::atomic<bool> mBuffering;
         std::vector<libtorrent::piece_index_t> mBufferPieces;
+        std::vector<bool> mBufferMissing;
+        std::unordered_map<int, std::int64_t> mBufferPartialBytes;
         std::int64_t mBufferSize;
+        std::int64_t mBufferBytesMissing;
+        std::int64_t mBufferBytesPartial;
+        std::atomic<bool> mBufferResync;
     };
 
 }}
@@ -0,0 +1,52 @@
+#include "file_table.h"
+
+#include <unordered_map>
+
+namespace torrest { namespace bittorrent {
+
+    FileTable::FileTable(const libtorrent::file_storage &pFileStorage)
+            : mTotalSize(pFileStorage.total_size()),
+              mPieceLength(pFileStorage.piece_length()),
+              mNumPieces(pFileStorage.num_pieces()) {
+        auto numFiles = static_cast<std::size_t>(pFileStorage.num_files());
+        std::unordered_map<std::string, std::uint32_t> directoryIds;
+
+        mOffsets.reserve(numFiles);
+        mSizes.reserve(numFiles);
+        mNameOffsets.reserve(numFiles + 1);
+        mDirectoryIds.reserve(numFiles);
+
+        for (std::size_t i = 0; i < numFiles; i++) {
+            libtorrent::file_index_t index(static_cast<int>(i));
+            auto path = pFileStorage.file_path(index);
+            auto name = pFileStorage.file_name(index);
+            // The directory keeps its trailing separator, so that the path is the concatenation of both
+            auto directory = path.substr(0, path.size() - name.size());
+
+            auto it = directoryIds.find(directory);
+            if (it == directoryIds.end()) {
+                it = directoryIds.emplace(directory, static_cast<std::uint32_t>(mDirectories.size())).first;
+                mDirectories.push_back(directory);
+            }
+
+            mOffsets.push_back(pFileStorage.file_offset(index));
+            mSizes.push_back(pFileStorage.file_size(index));
+            mNameOffsets.push_back(static_cast<std::uint32_t>(mNames.size()));
+            mDirectoryIds.push_back(it->second);
+            mNames.append(name.data(), name.size());
+        }
+
+        mNameOffsets.push_back(static_cast<std::uint32_t>(mNames.size()));
+        mNames.shrink_to_fit();
+    }
+
+    std::string FileTable::file_name(int pIndex) const {
+        auto start = mNameOffsets.at(pIndex);
+        return mNames.substr(start, mNameOffsets.at(pIndex + 1) - start);
+    }
+
+    std::string FileTable::file_path(int pIndex) const {
+        return mDirectories.at(mDirectoryIds.at(pIndex)) + file_name(pIndex);
+    }
+
+}}
@@ -0,0 +1,55 @@
+#ifndef TORREST_FILE_TABLE_H
+#define TORREST_FILE_TABLE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "libtorrent/file_storage.hpp"
+
+namespace torrest { namespace bittorrent {
+
+    /**
+     * Compact, immutable description of the files of a torrent. Offsets and sizes are kept in
+     * flat arrays and file names are stored in a single buffer, while directories are interned,
+     * so that torrents with a huge number of files are cheap to keep in memory.
+     */
+    class FileTable {
+    public:
+        explicit FileTable(const libtorrent::file_storage &pFileStorage);
+
+        int num_files() const { return static_cast<int>(mSizes.size()); }
+
+        int piece_length() const { return mPieceLength; }
+
+        int num_pieces() const { return mNumPieces; }
+
+        int piece_size(int pPiece) const {
+            return pPiece == mNumPieces - 1 ? int(mTotalSize - std::int64_t(mPieceLength) * pPiece) : mPieceLength;
+        }
+
+        std::int64_t file_offset(int pIndex) const { return mOffsets.at(pIndex); }
+
+        std::int64_t file_size(int pIndex) const { return mSizes.at(pIndex); }
+
+        std::uint32_t directory_id(int pIndex) const { return mDirectoryIds.at(pIndex); }
+
+        std::string file_name(int pIndex) const;
+
+        std::string file_path(int pIndex) const;
+
+    private:
+        std::vector<std::int64_t> mOffsets;
+        std::vector<std::int64_t> mSizes;
+        std::vector<std::uint32_t> mNameOffsets;
+        std::vector<std::uint32_t> mDirectoryIds;
+        std::vector<std::string> mDirectories;
+        std::string mNames;
+        std::int64_t mTotalSize;
+        int mPieceLength;
+        int mNumPieces;
+    };
+
+}}
+
+#endif //TORREST_FILE_TABLE_H
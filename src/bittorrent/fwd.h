@@ -9,8 +9,14 @@ namespace torrest { namespace bittorrent {
 
     class File;
 
+    class FileTable;
+
     class Reader;
 
+    class StreamingPlugin;
+
+    class MemoryBuffer;
+
     class ServiceSettings;
 
 }}
@@ -0,0 +1,544 @@
+#include "log_torrent_store.h"
+
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "boost/crc.hpp"
+#include "boost/filesystem.hpp"
+
+#define LOG_MAGIC "TRSTLOG1"
+#define LOG_MAGIC_SIZE 8
+#define RECORD_HEADER_SIZE 8
+#define RECORD_KEY_HEADER_SIZE 3
+#define COMMIT_DELAY 50
+#define COMPACTION_MIN_SIZE (1024 * 1024)
+#define RETRY_MIN_DELAY 1000
+#define RETRY_MAX_DELAY 60000
+
+namespace torrest { namespace bittorrent {
+
+    namespace {
+
+        enum RecordOperation : std::uint8_t {
+            ro_put,
+            ro_delete
+        };
+
+        void put_u32(std::vector<char> &pBuffer, std::uint32_t pValue) {
+            for (int i = 0; i < 4; i++) {
+                pBuffer.push_back(static_cast<char>((pValue >> (8 * i)) & 0xff));
+            }
+        }
+
+        std::uint32_t get_u32(const char *pData) {
+            std::uint32_t value = 0;
+            for (int i = 0; i < 4; i++) {
+                value |= std::uint32_t(static_cast<std::uint8_t>(pData[i])) << (8 * i);
+            }
+            return value;
+        }
+
+        std::uint32_t checksum(const char *pData, std::size_t pSize) {
+            boost::crc_32_type crc;
+            crc.process_bytes(pData, pSize);
+            return crc.checksum();
+        }
+
+        /**
+         * Appends a record to the buffer. The record is composed of a header (payload crc32 and payload size)
+         * followed by the payload (operation, record type, info hash size, info hash and data).
+         */
+        void append_record(std::vector<char> &pBuffer,
+                           RecordOperation pOperation,
+                           TorrentRecordType pType,
+                           const std::string &pInfoHash,
+                           const std::vector<char> &pData) {
+            std::vector<char> payload;
+            payload.reserve(RECORD_KEY_HEADER_SIZE + pInfoHash.size() + pData.size());
+            payload.push_back(static_cast<char>(pOperation));
+            payload.push_back(static_cast<char>(pType));
+            payload.push_back(static_cast<char>(pInfoHash.size()));
+            payload.insert(payload.end(), pInfoHash.begin(), pInfoHash.end());
+            payload.insert(payload.end(), pData.begin(), pData.end());
+
+            put_u32(pBuffer, checksum(payload.data(), payload.size()));
+            put_u32(pBuffer, static_cast<std::uint32_t>(payload.size()));
+            pBuffer.insert(pBuffer.end(), payload.begin(), payload.end());
+        }
+
+        bool seek_file(std::FILE *pFile, std::uint64_t pOffset) {
+#if defined(_WIN32)
+            return _fseeki64(pFile, static_cast<__int64>(pOffset), SEEK_SET) == 0;
+#else
+            return fseeko(pFile, static_cast<off_t>(pOffset), SEEK_SET) == 0;
+#endif
+        }
+
+        bool sync_file(std::FILE *pFile) {
+            if (std::fflush(pFile) != 0) {
+                return false;
+            }
+#if defined(_WIN32)
+            return _commit(_fileno(pFile)) == 0;
+#else
+            return fsync(fileno(pFile)) == 0;
+#endif
+        }
+
+        bool write_file(std::FILE *pFile, const std::vector<char> &pBuffer) {
+            return std::fwrite(pBuffer.data(), 1, pBuffer.size(), pFile) == pBuffer.size();
+        }
+
+        bool sync_directory(const boost::filesystem::path &pPath) {
+#if defined(_WIN32)
+            // Renames are durable once the call returns
+            return true;
+#else
+            auto fd = ::open(pPath.empty() ? "." : pPath.c_str(), O_RDONLY);
+            if (fd < 0) {
+                return false;
+            }
+            auto success = fsync(fd) == 0;
+            ::close(fd);
+            return success;
+#endif
+        }
+
+    }
+
+    LogTorrentStore::LogTorrentStore(std::string pPath, std::shared_ptr<spdlog::logger> pLogger)
+            : mPath(std::move(pPath)),
+              mLogger(std::move(pLogger)),
+              mFile(nullptr),
+              mSize(0),
+              mLiveSize(0),
+              mReplayedValid(false),
+              mReady(false),
+              mBusy(false),
+              mRetrying(false),
+              mFlushRequested(false),
+              mIsRunning(true),
+              mThread(&LogTorrentStore::run, this) {}
+
+    LogTorrentStore::~LogTorrentStore() {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mIsRunning = false;
+        }
+        mCv.notify_all();
+        mThread.join();
+
+        if (mFile != nullptr) {
+            std::fclose(mFile);
+        }
+    }
+
+    void LogTorrentStore::save(TorrentRecordType pType, const std::string &pInfoHash, DataProvider pProvider) {
+        mLogger->trace("operation=save, type={}, infoHash={}", int(pType), pInfoHash);
+        Key key(pType, pInfoHash);
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            auto it = mOperations.find(key);
+            if (it == mOperations.end()) {
+                mKeys.push_back(key);
+                mOperations.emplace(key, Operation{key, false, std::move(pProvider)});
+            } else {
+                it->second.remove = false;
+                it->second.provider = std::move(pProvider);
+            }
+        }
+        mCv.notify_all();
+    }
+
+    void LogTorrentStore::remove(TorrentRecordType pType, const std::string &pInfoHash) {
+        mLogger->trace("operation=remove, type={}, infoHash={}", int(pType), pInfoHash);
+        Key key(pType, pInfoHash);
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            auto it = mOperations.find(key);
+            if (it == mOperations.end()) {
+                mKeys.push_back(key);
+                mOperations.emplace(key, Operation{key, true, nullptr});
+            } else {
+                it->second.remove = true;
+                it->second.provider = nullptr;
+            }
+        }
+        mCv.notify_all();
+    }
+
+    std::vector<char> LogTorrentStore::get(TorrentRecordType pType, const std::string &pInfoHash) {
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mIdleCv.wait(lock, [this] { return mReady; });
+        }
+
+        std::lock_guard<std::mutex> lock(mFileMutex);
+        auto it = mIndex.find(Key(pType, pInfoHash));
+        if (it == mIndex.end()) {
+            throw std::runtime_error("Record not found");
+        }
+        return read_record(it->second);
+    }
+
+    std::vector<TorrentRecord> LogTorrentStore::load() {
+        flush();
+        std::lock_guard<std::mutex> lock(mFileMutex);
+
+        if (mReplayedValid) {
+            // Nothing was written since the log was replayed, so the replayed records are up to date
+            mReplayedValid = false;
+            return std::move(mReplayed);
+        }
+
+        std::vector<TorrentRecord> records;
+        for (auto &entry : mIndex) {
+            records.push_back(TorrentRecord{entry.first.first, entry.first.second, read_record(entry.second)});
+        }
+        return records;
+    }
+
+    void LogTorrentStore::flush() {
+        mLogger->trace("operation=flush");
+        std::unique_lock<std::mutex> lock(mMutex);
+        if (!mKeys.empty()) {
+            mFlushRequested = true;
+            mCv.notify_all();
+        }
+        // Operations waiting for a retry are not waited, as the storage may be failing for a long time
+        mIdleCv.wait(lock, [this] { return mReady && (mKeys.empty() || mRetrying) && !mBusy; });
+    }
+
+    void LogTorrentStore::run() {
+        mLogger->debug("operation=run, message='Initializing log store', path='{}'", mPath);
+
+        try {
+            std::lock_guard<std::mutex> lock(mFileMutex);
+            open();
+            replay();
+        } catch (const std::exception &e) {
+            mLogger->error("operation=run, message='Failed opening log store', what='{}', path='{}'", e.what(), mPath);
+        }
+
+        std::unique_lock<std::mutex> lock(mMutex);
+        mReady = true;
+        mIdleCv.notify_all();
+        auto retryDelay = std::chrono::milliseconds(RETRY_MIN_DELAY);
+
+        while (true) {
+            mCv.wait(lock, [this] { return !mKeys.empty() || !mIsRunning; });
+            if (mKeys.empty()) {
+                // Only exit once all pending operations are committed
+                break;
+            }
+
+            // Group commit - wait a bit so that concurrent operations are committed together
+            mCv.wait_for(lock, std::chrono::milliseconds(COMMIT_DELAY),
+                         [this] { return mFlushRequested || !mIsRunning; });
+
+            std::vector<Operation> operations;
+            operations.reserve(mKeys.size());
+            for (auto &key : mKeys) {
+                auto it = mOperations.find(key);
+                operations.push_back(std::move(it->second));
+            }
+            mKeys.clear();
+            mOperations.clear();
+            mFlushRequested = false;
+            mBusy = true;
+            lock.unlock();
+
+            bool committed = true;
+            try {
+                commit(operations);
+            } catch (const std::exception &e) {
+                mLogger->error("operation=run, message='Failed committing operations', what='{}', count={}",
+                               e.what(), operations.size());
+                committed = false;
+            }
+
+            lock.lock();
+            mBusy = false;
+
+            if (committed) {
+                mRetrying = false;
+                retryDelay = std::chrono::milliseconds(RETRY_MIN_DELAY);
+            } else if (mIsRunning) {
+                requeue(operations);
+                mRetrying = true;
+                mIdleCv.notify_all();
+                mLogger->debug("operation=run, message='Retrying operations', count={}, delay={}",
+                               operations.size(), retryDelay.count());
+                mCv.wait_for(lock, retryDelay, [this] { return !mIsRunning; });
+                retryDelay = std::min(2 * retryDelay, std::chrono::milliseconds(RETRY_MAX_DELAY));
+                continue;
+            } else {
+                mLogger->error("operation=run, message='Discarding operations on shutdown', count={}",
+                               operations.size());
+            }
+
+            if (mKeys.empty()) {
+                mIdleCv.notify_all();
+            }
+        }
+
+        mLogger->debug("operation=run, message='Terminating log store'");
+    }
+
+    void LogTorrentStore::requeue(std::vector<Operation> &pOperations) {
+        // Operations queued meanwhile are newer, so they take precedence over the failed ones
+        for (auto it = pOperations.rbegin(); it != pOperations.rend(); ++it) {
+            if (mOperations.find(it->key) == mOperations.end()) {
+                mKeys.push_front(it->key);
+                mOperations.emplace(it->key, std::move(*it));
+            }
+        }
+    }
+
+    void LogTorrentStore::open() {
+        if (mFile != nullptr) {
+            std::fclose(mFile);
+            mFile = nullptr;
+        }
+
+        if (boost::filesystem::exists(mPath)) {
+            mFile = std::fopen(mPath.c_str(), "r+b");
+        } else if ((mFile = std::fopen(mPath.c_str(), "w+b")) != nullptr) {
+            std::vector<char> magic(LOG_MAGIC, LOG_MAGIC + LOG_MAGIC_SIZE);
+            if (!write_file(mFile, magic) || !sync_file(mFile)) {
+                throw std::runtime_error("Unable to initialize log file");
+            }
+        }
+
+        if (mFile == nullptr) {
+            throw std::runtime_error("Unable to open log file");
+        }
+    }
+
+    void LogTorrentStore::replay() {
+        // The whole log is read at once, with a single sequential read
+        mSize = boost::filesystem::file_size(mPath);
+        std::vector<char> buffer(mSize);
+        if (!seek_file(mFile, 0) || std::fread(buffer.data(), 1, buffer.size(), mFile) != buffer.size()) {
+            throw std::runtime_error("Unable to read log file");
+        }
+
+        if (mSize < LOG_MAGIC_SIZE || std::memcmp(buffer.data(), LOG_MAGIC, LOG_MAGIC_SIZE) != 0) {
+            auto corruptedPath = mPath + ".corrupted";
+            mLogger->error("operation=replay, message='Invalid log file, moving it to {}', path='{}'",
+                           corruptedPath, mPath);
+            std::fclose(mFile);
+            mFile = nullptr;
+            boost::filesystem::rename(mPath, corruptedPath);
+            open();
+            mSize = LOG_MAGIC_SIZE;
+            return;
+        }
+
+        std::uint64_t offset = LOG_MAGIC_SIZE;
+        while (offset + RECORD_HEADER_SIZE <= mSize) {
+            auto crc = get_u32(&buffer[offset]);
+            auto size = get_u32(&buffer[offset + 4]);
+            if (size < RECORD_KEY_HEADER_SIZE || offset + RECORD_HEADER_SIZE + size > mSize) {
+                break;
+            }
+
+            auto payload = &buffer[offset + RECORD_HEADER_SIZE];
+            auto operation = static_cast<std::uint8_t>(payload[0]);
+            auto type = static_cast<std::uint8_t>(payload[1]);
+            auto infoHashSize = static_cast<std::uint8_t>(payload[2]);
+            if (checksum(payload, size) != crc || type >= tr_num_values
+                || RECORD_KEY_HEADER_SIZE + infoHashSize > size) {
+                break;
+            }
+
+            Key key(static_cast<TorrentRecordType>(type),
+                    std::string(payload + RECORD_KEY_HEADER_SIZE, infoHashSize));
+            auto it = mIndex.find(key);
+            if (it != mIndex.end()) {
+                mLiveSize -= it->second.record_size;
+                mIndex.erase(it);
+            }
+
+            if (operation == ro_put) {
+                auto headerSize = RECORD_HEADER_SIZE + RECORD_KEY_HEADER_SIZE + infoHashSize;
+                auto location = Location{offset + headerSize, size + RECORD_HEADER_SIZE - headerSize,
+                                         size + RECORD_HEADER_SIZE};
+                mIndex.emplace(key, location);
+                mLiveSize += location.record_size;
+            }
+
+            offset += RECORD_HEADER_SIZE + size;
+        }
+
+        if (offset < mSize) {
+            // Most likely a crash happened while committing
+            mLogger->warn("operation=replay, message='Discarding log tail', size={}, validSize={}", mSize, offset);
+            std::fclose(mFile);
+            mFile = nullptr;
+            boost::filesystem::resize_file(mPath, offset);
+            open();
+            mSize = offset;
+        }
+
+        mReplayed.clear();
+        mReplayed.reserve(mIndex.size());
+        for (auto &entry : mIndex) {
+            auto data = buffer.begin() + std::ptrdiff_t(entry.second.offset);
+            mReplayed.push_back(TorrentRecord{
+                    entry.first.first, entry.first.second, std::vector<char>(data, data + entry.second.size)});
+        }
+        mReplayedValid = true;
+
+        mLogger->debug("operation=replay, message='Replayed log', records={}, size={}, liveSize={}",
+                       mIndex.size(), mSize, mLiveSize);
+
+        check_compaction();
+    }
+
+    void LogTorrentStore::commit(std::vector<Operation> &pOperations) {
+        std::vector<char> buffer;
+        std::vector<std::pair<const Operation *, std::uint64_t>> committed;
+
+        for (auto &operation : pOperations) {
+            std::vector<char> data;
+            if (!operation.remove) {
+                try {
+                    data = operation.provider();
+                } catch (const std::exception &e) {
+                    mLogger->error("operation=commit, message='Failed getting record data', what='{}', infoHash={}",
+                                   e.what(), operation.key.second);
+                    continue;
+                }
+            }
+
+            committed.emplace_back(&operation, buffer.size());
+            append_record(buffer, operation.remove ? ro_delete : ro_put,
+                          operation.key.first, operation.key.second, data);
+        }
+
+        std::lock_guard<std::mutex> lock(mFileMutex);
+        if (mFile == nullptr) {
+            throw std::runtime_error("Log file is not open");
+        }
+
+        if (!seek_file(mFile, mSize) || !write_file(mFile, buffer) || !sync_file(mFile)) {
+            // Drop the partially written records, otherwise they would hide any following record
+            std::fclose(mFile);
+            mFile = nullptr;
+            boost::filesystem::resize_file(mPath, mSize);
+            open();
+            throw std::runtime_error("Unable to write log file");
+        }
+
+        for (std::size_t i = 0; i < committed.size(); i++) {
+            auto &key = committed[i].first->key;
+            auto recordOffset = committed[i].second;
+            auto recordSize = (i + 1 < committed.size() ? committed[i + 1].second : buffer.size()) - recordOffset;
+
+            auto it = mIndex.find(key);
+            if (it != mIndex.end()) {
+                mLiveSize -= it->second.record_size;
+                mIndex.erase(it);
+            }
+
+            if (!committed[i].first->remove) {
+                auto headerSize = RECORD_HEADER_SIZE + RECORD_KEY_HEADER_SIZE + key.second.size();
+                auto location = Location{mSize + recordOffset + headerSize,
+                                         static_cast<std::uint32_t>(recordSize - headerSize),
+                                         static_cast<std::uint32_t>(recordSize)};
+                mIndex.emplace(key, location);
+                mLiveSize += location.record_size;
+            }
+        }
+
+        mSize += buffer.size();
+        mReplayed.clear();
+        mReplayedValid = false;
+
+        // The records are already committed, so a compaction failure must not fail the commit
+        check_compaction();
+    }
+
+    void LogTorrentStore::check_compaction() {
+        if (!needs_compaction()) {
+            return;
+        }
+
+        try {
+            compact();
+        } catch (const std::exception &e) {
+            mLogger->error("operation=check_compaction, message='Failed compacting log', what='{}', path='{}'",
+                           e.what(), mPath);
+        }
+    }
+
+    void LogTorrentStore::compact() {
+        mLogger->debug("operation=compact, message='Compacting log', size={}, liveSize={}", mSize, mLiveSize);
+        auto tmpPath = mPath + ".tmp";
+        auto tmpFile = std::fopen(tmpPath.c_str(), "wb");
+        if (tmpFile == nullptr) {
+            throw std::runtime_error("Unable to create compacted log file");
+        }
+
+        std::map<Key, Location> index;
+        std::uint64_t size = LOG_MAGIC_SIZE;
+        bool success = write_file(tmpFile, std::vector<char>(LOG_MAGIC, LOG_MAGIC + LOG_MAGIC_SIZE));
+
+        for (auto it = mIndex.begin(); success && it != mIndex.end(); it++) {
+            std::vector<char> buffer;
+            append_record(buffer, ro_put, it->first.first, it->first.second, read_record(it->second));
+            success = write_file(tmpFile, buffer);
+            index.emplace(it->first, Location{
+                    size + buffer.size() - it->second.size, it->second.size, it->second.record_size});
+            size += buffer.size();
+        }
+
+        success = success && sync_file(tmpFile);
+        std::fclose(tmpFile);
+        if (!success) {
+            boost::filesystem::remove(tmpPath);
+            throw std::runtime_error("Unable to write compacted log file");
+        }
+
+        std::fclose(mFile);
+        mFile = nullptr;
+        boost::system::error_code errorCode;
+        boost::filesystem::rename(tmpPath, mPath, errorCode);
+        open();
+
+        if (errorCode.failed()) {
+            boost::filesystem::remove(tmpPath, errorCode);
+            throw std::runtime_error("Unable to replace log file");
+        }
+
+        if (!sync_directory(boost::filesystem::path(mPath).parent_path())) {
+            mLogger->warn("operation=compact, message='Unable to sync log directory', path='{}'", mPath);
+        }
+
+        mIndex = std::move(index);
+        mSize = size;
+        mLogger->debug("operation=compact, message='Compacted log', size={}", mSize);
+    }
+
+    bool LogTorrentStore::needs_compaction() const {
+        return mSize > COMPACTION_MIN_SIZE && mSize > 2 * (mLiveSize + LOG_MAGIC_SIZE);
+    }
+
+    std::vector<char> LogTorrentStore::read_record(const Location &pLocation) const {
+        std::vector<char> data(pLocation.size);
+        if (!seek_file(mFile, pLocation.offset) || std::fread(data.data(), 1, data.size(), mFile) != data.size()) {
+            throw std::runtime_error("Unable to read log record");
+        }
+        return data;
+    }
+
+}}
@@ -0,0 +1,98 @@
+#ifndef TORREST_LOG_TORRENT_STORE_H
+#define TORREST_LOG_TORRENT_STORE_H
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include "torrent_store.h"
+
+namespace torrest { namespace bittorrent {
+
+    /**
+     * Stores all records in a single append-only log file. Pending writes are grouped and
+     * committed with a single sync (failed commits are retried with backoff), the log is replayed
+     * on open (discarding any torn or corrupted tail) and it is compacted once most of its records
+     * are stale.
+     */
+    class LogTorrentStore : public TorrentStore {
+    public:
+        LogTorrentStore(std::string pPath, std::shared_ptr<spdlog::logger> pLogger);
+
+        ~LogTorrentStore() override;
+
+        void save(TorrentRecordType pType, const std::string &pInfoHash, DataProvider pProvider) override;
+
+        void remove(TorrentRecordType pType, const std::string &pInfoHash) override;
+
+        std::vector<char> get(TorrentRecordType pType, const std::string &pInfoHash) override;
+
+        std::vector<TorrentRecord> load() override;
+
+        void flush() override;
+
+        LogTorrentStore(LogTorrentStore const &) = delete;
+
+        void operator=(LogTorrentStore const &) = delete;
+
+    private:
+        typedef std::pair<TorrentRecordType, std::string> Key;
+
+        struct Operation {
+            Key key;
+            bool remove;
+            DataProvider provider;
+        };
+
+        struct Location {
+            std::uint64_t offset;
+            std::uint32_t size;
+            std::uint32_t record_size;
+        };
+
+        void run();
+
+        void open();
+
+        void replay();
+
+        void requeue(std::vector<Operation> &pOperations);
+
+        void commit(std::vector<Operation> &pOperations);
+
+        void check_compaction();
+
+        void compact();
+
+        bool needs_compaction() const;
+
+        std::vector<char> read_record(const Location &pLocation) const;
+
+        std::string mPath;
+        std::shared_ptr<spdlog::logger> mLogger;
+        std::FILE *mFile;
+        std::uint64_t mSize;
+        std::uint64_t mLiveSize;
+        std::map<Key, Location> mIndex;
+        std::vector<TorrentRecord> mReplayed;
+        bool mReplayedValid;
+        std::deque<Key> mKeys;
+        std::map<Key, Operation> mOperations;
+        std::mutex mMutex;
+        std::mutex mFileMutex;
+        std::condition_variable mCv;
+        std::condition_variable mIdleCv;
+        bool mReady;
+        bool mBusy;
+        bool mRetrying;
+        bool mFlushRequested;
+        bool mIsRunning;
+        std::thread mThread;
+    };
+
+}}
+
+#endif //TORREST_LOG_TORRENT_STORE_H
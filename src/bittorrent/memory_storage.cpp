@@ -0,0 +1,246 @@
+#include "memory_storage.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#if TORRENT_ABI_VERSION <= 2
+#include "libtorrent/operations.hpp"
+#endif
+
+#define MEMORY_BLOCK_SIZE 0x4000
+#define MIN_MEMORY_PIECES 8
+#define BEHIND_READER_FACTOR 4
+
+namespace torrest { namespace bittorrent {
+
+    MemoryBuffer::MemoryBuffer(std::int64_t pCapacity, std::string pInfoHash, std::shared_ptr<spdlog::logger> pLogger)
+            : mCapacity(pCapacity),
+              mInfoHash(std::move(pInfoHash)),
+              mLogger(std::move(pLogger)),
+              mMaxPieces(MIN_MEMORY_PIECES) {}
+
+    void MemoryBuffer::set_piece_length(int pPieceLength) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mMaxPieces = static_cast<int>(std::max<std::int64_t>(mCapacity / pPieceLength, MIN_MEMORY_PIECES));
+        mLogger->debug("operation=set_piece_length, message='Memory buffer configured', pieceLength={}, "
+                       "maxPieces={}, infoHash={}", pPieceLength, mMaxPieces, mInfoHash);
+    }
+
+    int MemoryBuffer::read(int pPiece, int pOffset, char *pBuf, int pSize) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto it = mPieces.find(pPiece);
+        if (it == mPieces.end()) {
+            return -1;
+        }
+
+        auto &data = it->second.data;
+        auto size = std::max(std::min<int>(pSize, static_cast<int>(data.size()) - pOffset), 0);
+        std::memcpy(pBuf, data.data() + pOffset, size);
+        return size;
+    }
+
+    void MemoryBuffer::write(int pPiece, int pPieceSize, int pOffset, const char *pBuf, int pSize) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto it = mPieces.find(pPiece);
+        if (it == mPieces.end()) {
+            evict_pieces(pPiece);
+            mEvictedPieces.erase(pPiece);
+            auto numBlocks = (pPieceSize + MEMORY_BLOCK_SIZE - 1) / MEMORY_BLOCK_SIZE;
+            it = mPieces.emplace(pPiece, MemoryPiece{
+                    std::vector<char>(pPieceSize), std::vector<bool>(numBlocks, false), false}).first;
+        }
+
+        auto &piece = it->second;
+        auto size = std::max(std::min<int>(pSize, static_cast<int>(piece.data.size()) - pOffset), 0);
+        std::memcpy(piece.data.data() + pOffset, pBuf, size);
+
+        if (!piece.complete && size > 0) {
+            auto lastBlock = (pOffset + size - 1) / MEMORY_BLOCK_SIZE;
+            for (auto b = pOffset / MEMORY_BLOCK_SIZE; b <= lastBlock; b++) {
+                piece.blocks[b] = true;
+            }
+            piece.complete = std::all_of(piece.blocks.begin(), piece.blocks.end(), [](bool pDone) { return pDone; });
+        }
+    }
+
+    bool MemoryBuffer::has_piece(int pPiece) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto it = mPieces.find(pPiece);
+        return it != mPieces.end() && it->second.complete;
+    }
+
+    bool MemoryBuffer::is_evicted(int pPiece) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mEvictedPieces.count(pPiece) > 0;
+    }
+
+    void MemoryBuffer::set_reader_piece(const void *pReader, int pPiece) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mReaderPieces[pReader] = pPiece;
+    }
+
+    void MemoryBuffer::remove_reader(const void *pReader) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mReaderPieces.erase(pReader);
+    }
+
+    void MemoryBuffer::set_protected_pieces(const void *pOwner, std::vector<int> pPieces) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (pPieces.empty()) {
+            mOwnerProtectedPieces.erase(pOwner);
+        } else {
+            mOwnerProtectedPieces[pOwner] = std::move(pPieces);
+        }
+
+        // Rebuilt on every change, so that eviction looks up protected pieces in constant time
+        mProtectedPieces.clear();
+        for (auto &entry : mOwnerProtectedPieces) {
+            mProtectedPieces.insert(entry.second.begin(), entry.second.end());
+        }
+    }
+
+    bool MemoryBuffer::is_protected(int pPiece) const {
+        return mProtectedPieces.count(pPiece) > 0;
+    }
+
+    void MemoryBuffer::clear() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mPieces.clear();
+        mEvictedPieces.clear();
+    }
+
+    std::int64_t MemoryBuffer::get_eviction_score(int pPiece) const {
+        if (mReaderPieces.empty()) {
+            return 0;
+        }
+
+        auto score = std::numeric_limits<std::int64_t>::max();
+        for (auto &reader : mReaderPieces) {
+            auto distance = pPiece >= reader.second
+                            ? static_cast<std::int64_t>(pPiece - reader.second)
+                            : static_cast<std::int64_t>(reader.second - pPiece) * BEHIND_READER_FACTOR;
+            score = std::min(score, distance);
+        }
+        return score;
+    }
+
+    void MemoryBuffer::evict_pieces(int pPiece) {
+        while (static_cast<int>(mPieces.size()) >= mMaxPieces) {
+            auto evicted = mPieces.end();
+            std::int64_t evictedScore = -1;
+            for (auto it = mPieces.begin(); it != mPieces.end(); ++it) {
+                if (it->first != pPiece && it->second.complete && !is_protected(it->first)) {
+                    auto score = get_eviction_score(it->first);
+                    if (score > evictedScore) {
+                        evicted = it;
+                        evictedScore = score;
+                    }
+                }
+            }
+
+            if (evicted == mPieces.end()) {
+                mLogger->trace("operation=evict_pieces, message='No evictable pieces', pieces={}, "
+                               "infoHash={}", mPieces.size(), mInfoHash);
+                return;
+            }
+
+            mLogger->trace("operation=evict_pieces, piece={}, score={}, infoHash={}",
+                           evicted->first, evictedScore, mInfoHash);
+            mEvictedPieces.insert(evicted->first);
+            mPieces.erase(evicted);
+        }
+    }
+
+#if TORRENT_ABI_VERSION <= 2
+
+    MemoryStorage::MemoryStorage(const libtorrent::file_storage &pFiles, std::shared_ptr<MemoryBuffer> pBuffer)
+            : libtorrent::storage_interface(pFiles),
+              mBuffer(std::move(pBuffer)) {
+        mBuffer->set_piece_length(pFiles.piece_length());
+    }
+
+    std::shared_ptr<MemoryBuffer> MemoryStorage::attach(libtorrent::add_torrent_params &pTorrentParams,
+                                                        std::int64_t pCapacity,
+                                                        const std::string &pInfoHash,
+                                                        std::shared_ptr<spdlog::logger> pLogger) {
+        auto buffer = std::make_shared<MemoryBuffer>(pCapacity, pInfoHash, std::move(pLogger));
+        pTorrentParams.storage = [buffer](const libtorrent::storage_params &pParams, libtorrent::file_pool &) {
+            return static_cast<libtorrent::storage_interface *>(new MemoryStorage(pParams.files, buffer));
+        };
+        return buffer;
+    }
+
+    void MemoryStorage::initialize(libtorrent::storage_error &) {}
+
+    int MemoryStorage::readv(libtorrent::span<libtorrent::iovec_t const> pBufs,
+                             libtorrent::piece_index_t pPiece,
+                             int pOffset,
+                             libtorrent::open_mode_t,
+                             libtorrent::storage_error &pError) {
+        int n = 0;
+        for (auto &buf : pBufs) {
+            auto size = static_cast<int>(buf.size());
+            auto readSize = mBuffer->read(static_cast<int>(pPiece), pOffset + n, buf.data(), size);
+            if (readSize < 0) {
+                // The piece was evicted from memory
+                pError.ec = boost::system::errc::make_error_code(boost::system::errc::not_enough_memory);
+                pError.operation = libtorrent::operation_t::file_read;
+                return n;
+            }
+            n += readSize;
+            if (readSize < size) {
+                break;
+            }
+        }
+        return n;
+    }
+
+    int MemoryStorage::writev(libtorrent::span<libtorrent::iovec_t const> pBufs,
+                              libtorrent::piece_index_t pPiece,
+                              int pOffset,
+                              libtorrent::open_mode_t,
+                              libtorrent::storage_error &) {
+        auto pieceSize = files().piece_size(pPiece);
+        int n = 0;
+        for (auto &buf : pBufs) {
+            auto size = static_cast<int>(buf.size());
+            mBuffer->write(static_cast<int>(pPiece), pieceSize, pOffset + n, buf.data(), size);
+            n += size;
+        }
+        return n;
+    }
+
+    bool MemoryStorage::has_any_file(libtorrent::storage_error &) {
+        return false;
+    }
+
+    void MemoryStorage::set_file_priority(
+            libtorrent::aux::vector<libtorrent::download_priority_t, libtorrent::file_index_t> &,
+            libtorrent::storage_error &) {}
+
+    libtorrent::status_t MemoryStorage::move_storage(const std::string &,
+                                                     libtorrent::move_flags_t,
+                                                     libtorrent::storage_error &) {
+        return libtorrent::status_t::no_error;
+    }
+
+    bool MemoryStorage::verify_resume_data(const libtorrent::add_torrent_params &,
+                                           const libtorrent::aux::vector<std::string, libtorrent::file_index_t> &,
+                                           libtorrent::storage_error &) {
+        return true;
+    }
+
+    void MemoryStorage::release_files(libtorrent::storage_error &) {
+        // Files are released when the torrent is paused, which must not drop the pieces in memory
+    }
+
+    void MemoryStorage::rename_file(libtorrent::file_index_t, const std::string &, libtorrent::storage_error &) {}
+
+    void MemoryStorage::delete_files(libtorrent::remove_flags_t, libtorrent::storage_error &) {
+        mBuffer->clear();
+    }
+
+#endif //TORRENT_ABI_VERSION <= 2
+
+}}
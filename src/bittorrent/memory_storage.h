@@ -0,0 +1,133 @@
+#ifndef TORREST_MEMORY_STORAGE_H
+#define TORREST_MEMORY_STORAGE_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "libtorrent/add_torrent_params.hpp"
+#include "spdlog/spdlog.h"
+
+#if TORRENT_ABI_VERSION <= 2
+#include "libtorrent/storage.hpp"
+#endif
+
+namespace torrest { namespace bittorrent {
+
+    /**
+     * Bounded in-memory piece buffer. Pieces are kept around the positions of the active readers,
+     * evicting the completed pieces farthest from them, where pieces behind a reader count as farther
+     * than the ones ahead of it. Pieces still being downloaded and protected pieces, such as the
+     * files buffers, are never evicted, so the capacity is a soft limit.
+     */
+    class MemoryBuffer {
+    public:
+        MemoryBuffer(std::int64_t pCapacity, std::string pInfoHash, std::shared_ptr<spdlog::logger> pLogger);
+
+        void set_piece_length(int pPieceLength);
+
+        int read(int pPiece, int pOffset, char *pBuf, int pSize);
+
+        void write(int pPiece, int pPieceSize, int pOffset, const char *pBuf, int pSize);
+
+        bool has_piece(int pPiece);
+
+        bool is_evicted(int pPiece);
+
+        void set_reader_piece(const void *pReader, int pPiece);
+
+        void remove_reader(const void *pReader);
+
+        void set_protected_pieces(const void *pOwner, std::vector<int> pPieces);
+
+        void clear();
+
+    private:
+        struct MemoryPiece {
+            std::vector<char> data;
+            std::vector<bool> blocks;
+            bool complete;
+        };
+
+        bool is_protected(int pPiece) const;
+
+        std::int64_t get_eviction_score(int pPiece) const;
+
+        void evict_pieces(int pPiece);
+
+        std::int64_t mCapacity;
+        std::string mInfoHash;
+        std::shared_ptr<spdlog::logger> mLogger;
+        std::mutex mMutex;
+        std::unordered_map<int, MemoryPiece> mPieces;
+        std::unordered_set<int> mEvictedPieces;
+        std::unordered_map<const void *, int> mReaderPieces;
+        std::unordered_map<const void *, std::vector<int>> mOwnerProtectedPieces;
+        std::unordered_set<int> mProtectedPieces;
+        int mMaxPieces;
+    };
+
+#if TORRENT_ABI_VERSION <= 2
+
+    /**
+     * Libtorrent storage which keeps the torrent pieces in a MemoryBuffer instead of writing them
+     * to disk. Pieces evicted from the buffer fail to be read, so seeding is best-effort.
+     */
+    class MemoryStorage : public libtorrent::storage_interface {
+    public:
+        MemoryStorage(const libtorrent::file_storage &pFiles, std::shared_ptr<MemoryBuffer> pBuffer);
+
+        static std::shared_ptr<MemoryBuffer> attach(libtorrent::add_torrent_params &pTorrentParams,
+                                                    std::int64_t pCapacity,
+                                                    const std::string &pInfoHash,
+                                                    std::shared_ptr<spdlog::logger> pLogger);
+
+        void initialize(libtorrent::storage_error &pError) override;
+
+        int readv(libtorrent::span<libtorrent::iovec_t const> pBufs,
+                  libtorrent::piece_index_t pPiece,
+                  int pOffset,
+                  libtorrent::open_mode_t pFlags,
+                  libtorrent::storage_error &pError) override;
+
+        int writev(libtorrent::span<libtorrent::iovec_t const> pBufs,
+                   libtorrent::piece_index_t pPiece,
+                   int pOffset,
+                   libtorrent::open_mode_t pFlags,
+                   libtorrent::storage_error &pError) override;
+
+        bool has_any_file(libtorrent::storage_error &pError) override;
+
+        void set_file_priority(
+                libtorrent::aux::vector<libtorrent::download_priority_t, libtorrent::file_index_t> &pPriorities,
+                libtorrent::storage_error &pError) override;
+
+        libtorrent::status_t move_storage(const std::string &pSavePath,
+                                          libtorrent::move_flags_t pFlags,
+                                          libtorrent::storage_error &pError) override;
+
+        bool verify_resume_data(const libtorrent::add_torrent_params &pResumeData,
+                                const libtorrent::aux::vector<std::string, libtorrent::file_index_t> &pLinks,
+                                libtorrent::storage_error &pError) override;
+
+        void release_files(libtorrent::storage_error &pError) override;
+
+        void rename_file(libtorrent::file_index_t pIndex,
+                         const std::string &pNewFilename,
+                         libtorrent::storage_error &pError) override;
+
+        void delete_files(libtorrent::remove_flags_t pOptions, libtorrent::storage_error &pError) override;
+
+    private:
+        std::shared_ptr<MemoryBuffer> mBuffer;
+    };
+
+#endif //TORRENT_ABI_VERSION <= 2
+
+}}
+
+#endif //TORREST_MEMORY_STORAGE_H
@@ -0,0 +1,78 @@
+#include "persistence_queue.h"
+
+namespace torrest { namespace bittorrent {
+
+    PersistenceQueue::PersistenceQueue(std::shared_ptr<spdlog::logger> pLogger)
+            : mLogger(std::move(pLogger)),
+              mBusy(false),
+              mIsRunning(true),
+              mThread(&PersistenceQueue::run, this) {}
+
+    PersistenceQueue::~PersistenceQueue() {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mIsRunning = false;
+        }
+        mCv.notify_all();
+        mThread.join();
+    }
+
+    void PersistenceQueue::enqueue(const std::string &pKey, Task pTask) {
+        mLogger->trace("operation=enqueue, key='{}'", pKey);
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            auto it = mTasks.find(pKey);
+            if (it == mTasks.end()) {
+                mKeys.push_back(pKey);
+                mTasks.emplace(pKey, std::move(pTask));
+            } else {
+                mLogger->trace("operation=enqueue, message='Coalescing pending task', key='{}'", pKey);
+                it->second = std::move(pTask);
+            }
+        }
+        mCv.notify_one();
+    }
+
+    void PersistenceQueue::flush() {
+        mLogger->trace("operation=flush");
+        std::unique_lock<std::mutex> lock(mMutex);
+        mIdleCv.wait(lock, [this] { return mKeys.empty() && !mBusy; });
+    }
+
+    void PersistenceQueue::run() {
+        mLogger->debug("operation=run, message='Initializing persistence worker'");
+        std::unique_lock<std::mutex> lock(mMutex);
+
+        while (true) {
+            mCv.wait(lock, [this] { return !mKeys.empty() || !mIsRunning; });
+            if (mKeys.empty()) {
+                // Only exit once all pending tasks are done
+                break;
+            }
+
+            auto key = std::move(mKeys.front());
+            mKeys.pop_front();
+            auto it = mTasks.find(key);
+            auto task = std::move(it->second);
+            mTasks.erase(it);
+            mBusy = true;
+            lock.unlock();
+
+            try {
+                task();
+            } catch (const std::exception &e) {
+                mLogger->error("operation=run, message='Failed running persistence task', key='{}', what='{}'",
+                               key, e.what());
+            }
+
+            lock.lock();
+            mBusy = false;
+            if (mKeys.empty()) {
+                mIdleCv.notify_all();
+            }
+        }
+
+        mLogger->debug("operation=run, message='Terminating persistence worker'");
+    }
+
+}}
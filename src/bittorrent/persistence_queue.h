@@ -0,0 +1,53 @@
+#ifndef TORREST_PERSISTENCE_QUEUE_H
+#define TORREST_PERSISTENCE_QUEUE_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "spdlog/spdlog.h"
+
+namespace torrest { namespace bittorrent {
+
+    /**
+     * Runs disk persistence tasks on a dedicated worker thread. Tasks are identified by a key
+     * (usually the destination path) and a pending task is replaced when a new task with the
+     * same key is enqueued, so repeated saves of the same file are coalesced.
+     */
+    class PersistenceQueue {
+    public:
+        typedef std::function<void()> Task;
+
+        explicit PersistenceQueue(std::shared_ptr<spdlog::logger> pLogger);
+
+        ~PersistenceQueue();
+
+        void enqueue(const std::string &pKey, Task pTask);
+
+        void flush();
+
+        PersistenceQueue(PersistenceQueue const &) = delete;
+
+        void operator=(PersistenceQueue const &) = delete;
+
+    private:
+        void run();
+
+        std::shared_ptr<spdlog::logger> mLogger;
+        std::deque<std::string> mKeys;
+        std::unordered_map<std::string, Task> mTasks;
+        std::mutex mMutex;
+        std::condition_variable mCv;
+        std::condition_variable mIdleCv;
+        bool mBusy;
+        bool mIsRunning;
+        std::thread mThread;
+    };
+
+}}
+
+#endif //TORREST_PERSISTENCE_QUEUE_H
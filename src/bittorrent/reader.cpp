@@ -1,6 +1,10 @@
 #include "reader.h"
 
+#include <algorithm>
 #include <thread>
+#include <vector>
+
+#include "memory_storage.h"
 
 #if TORREST_LEGACY_READ_PIECE
 #if TORRENT_ABI_VERSION > 2
@@ -13,19 +17,36 @@
 namespace torrest { namespace bittorrent {
 
     Reader::Reader(std::shared_ptr<Torrent> pTorrent,
+                   int pFileIndex,
                    std::int64_t pOffset,
                    std::int64_t pSize,
                    std::int64_t pPieceLength,
                    double pReadAhead,
+                   std::int64_t pSequentialWindow,
+                   std::int64_t pPrefetchOffset,
                    int pPieceWaitTimeout)
             : mTorrent(std::move(pTorrent)),
+              mFileIndex(pFileIndex),
               mOffset(pOffset),
               mSize(pSize),
               mPieceLength(pPieceLength),
-              mPPieces(std::lround(pReadAhead * static_cast<double>(pSize) / static_cast<double>(pPieceLength))),
+              mPPieces(std::max<std::int64_t>(
+                      std::lround(pReadAhead * static_cast<double>(pSize) / static_cast<double>(pPieceLength)),
+                      (pSequentialWindow + pPieceLength - 1) / pPieceLength)),
               mPieceWaitTimeout(pPieceWaitTimeout),
               mLastPiece(piece_from_offset(pSize - 1)),
-              mPos(0) {}
+              mPos(0),
+              mPrefetchOffset(pPrefetchOffset) {
+        mTorrent->mReaders++;
+    }
+
+    Reader::~Reader() {
+        if (mTorrent->mMemoryBuffer != nullptr) {
+            mTorrent->mMemoryBuffer->remove_reader(this);
+        }
+        mTorrent->remove_deadline_windows(this);
+        mTorrent->mReaders--;
+    }
 
     std::int32_t Reader::piece_from_offset(std::int64_t pOffset) const {
         return static_cast<std::int32_t>((mOffset + pOffset) / mPieceLength);
@@ -69,6 +90,7 @@ namespace torrest { namespace bittorrent {
 
         auto startPiece = piece_from_offset(mPos);
         auto endPiece = piece_from_offset(mPos + size - 1);
+        set_memory_reader_piece(startPiece);
         set_pieces_priorities(startPiece, endPiece - startPiece);
         auto pieceWaitUntil = mPieceWaitTimeout > std::chrono::seconds::zero()
                               ? boost::optional<std::chrono::time_point<std::chrono::steady_clock>>(
@@ -119,27 +141,59 @@ namespace torrest { namespace bittorrent {
 #endif
 
         mPos += n;
+        mTorrent->update_read_position(mFileIndex, mPos, mSize);
+
+        if (mPrefetchOffset >= 0 && mPos >= mPrefetchOffset) {
+            mPrefetchOffset = -1;
+            try {
+                mTorrent->prefetch_next_file(mFileIndex);
+            } catch (const std::exception &e) {
+                mTorrent->mLogger->error("operation=read, message='Failed prefetching next file', what='{}', "
+                                         "infoHash={}", e.what(), mTorrent->mInfoHash);
+            }
+        }
+
         return n;
     }
 
-    void Reader::set_piece_priority(libtorrent::piece_index_t pPiece, int pDeadline,
-                                    libtorrent::download_priority_t pPriority) const {
-        if (mTorrent->mHandle.piece_priority(pPiece) < pPriority) {
-            mTorrent->mHandle.piece_priority(pPiece, pPriority);
-            mTorrent->mHandle.set_piece_deadline(pPiece, pDeadline);
+    void Reader::set_memory_reader_piece(std::int32_t pPiece) const {
+        // Pieces kept in memory are evicted based on their distance to the readers
+        if (mTorrent->mMemoryBuffer != nullptr) {
+            mTorrent->mMemoryBuffer->set_reader_piece(this, pPiece);
         }
     }
 
     void Reader::set_pieces_priorities(std::int32_t pPiece, std::int32_t pPieceEndOffset) const {
-        auto endPiece = pPiece + pPieceEndOffset + mPPieces;
-        for (std::int32_t i = 0, p = pPiece; p <= endPiece && p <= mLastPiece; p++, i++) {
+        auto endPiece = std::min<std::int64_t>(pPiece + pPieceEndOffset + mPPieces, mLastPiece);
+        // Deadline pieces outside of every reader window are no longer escalated
+        mTorrent->set_deadline_window(this, pPiece, static_cast<int>(endPiece));
+
+        auto status = mTorrent->mHandle.status(libtorrent::torrent_handle::query_pieces);
+        if (status.is_seeding) {
+            return;
+        }
+        auto priorities = mTorrent->mHandle.get_piece_priorities();
+        std::vector<std::pair<libtorrent::piece_index_t, libtorrent::download_priority_t>> changes;
+        std::vector<std::pair<libtorrent::piece_index_t, int>> deadlines;
+
+        // Only pieces missing and not yet at the wanted priority are updated
+        for (std::int32_t i = 0, p = pPiece; p <= endPiece; p++, i++) {
             libtorrent::piece_index_t pieceIndex(p);
-            if (!mTorrent->mHandle.have_piece(pieceIndex)) {
-                if (i <= pPieceEndOffset) {
-                    set_piece_priority(pieceIndex, 0, libtorrent::top_priority);
-                } else {
-                    set_piece_priority(pieceIndex, (i - pPieceEndOffset) * 10, libtorrent::download_priority_t(6));
-                }
+            if (!status.pieces.empty() && status.pieces.get_bit(pieceIndex)) {
+                continue;
+            }
+            auto isUrgent = i <= pPieceEndOffset;
+            auto priority = isUrgent ? libtorrent::top_priority : libtorrent::download_priority_t(6);
+            if (priorities.at(p) < priority) {
+                changes.emplace_back(pieceIndex, priority);
+                deadlines.emplace_back(pieceIndex, isUrgent ? 0 : (i - pPieceEndOffset) * 10);
+            }
+        }
+
+        if (!changes.empty()) {
+            mTorrent->mHandle.prioritize_pieces(changes);
+            for (auto &deadline : deadlines) {
+                mTorrent->set_piece_deadline(deadline.first, deadline.second);
             }
         }
     }
@@ -169,6 +223,7 @@ namespace torrest { namespace bittorrent {
         }
 
         mPos = off;
+        set_memory_reader_piece(piece_from_offset(off));
         set_pieces_priorities(piece_from_offset(off), 0);
         return off;
     }
@@ -13,12 +13,21 @@ namespace torrest { namespace bittorrent {
     class Reader {
     public:
         Reader(std::shared_ptr<Torrent> pTorrent,
+               int pFileIndex,
                std::int64_t pOffset,
                std::int64_t pSize,
                std::int64_t pPieceLength,
                double pReadAhead,
+               std::int64_t pSequentialWindow,
+               std::int64_t pPrefetchOffset,
                int pPieceWaitTimeout);
 
+        ~Reader();
+
+        Reader(Reader const &) = delete;
+
+        void operator=(Reader const &) = delete;
+
         std::int64_t read(void *pBuf, std::int64_t pSize);
 
         std::int64_t seek(std::int64_t pOff, int pWhence);
@@ -30,13 +39,13 @@ namespace torrest { namespace bittorrent {
 
         std::int32_t piece_offset_from_offset(std::int64_t pOffset) const;
 
-        void set_piece_priority(libtorrent::piece_index_t pPiece, int pDeadline,
-                                libtorrent::download_priority_t pPriority) const;
+        void set_memory_reader_piece(std::int32_t pPiece) const;
 
         void set_pieces_priorities(std::int32_t pPiece, std::int32_t pPieceEndOffset) const;
 
         mutable std::mutex mMutex;
         std::shared_ptr<Torrent> mTorrent;
+        int mFileIndex;
         std::int64_t mOffset;
         std::int64_t mSize;
         std::int64_t mPieceLength;
@@ -44,6 +53,7 @@ namespace torrest { namespace bittorrent {
         std::chrono::seconds mPieceWaitTimeout;
         std::int32_t mLastPiece;
         std::int64_t mPos;
+        std::int64_t mPrefetchOffset;
     };
 
 }}
@@ -1,19 +1,26 @@
 #include "service.h"
 
+#include <algorithm>
+#include <atomic>
 #include <thread>
-#include <fstream>
+#include <sstream>
+#include <stdexcept>
 
 #include "boost/algorithm/string.hpp"
 #include "boost/filesystem.hpp"
 #include "libtorrent/alert_types.hpp"
+#include "libtorrent/bdecode.hpp"
 #include "libtorrent/create_torrent.hpp"
 #include "libtorrent/magnet_uri.hpp"
 #include "libtorrent/read_resume_data.hpp"
+#include "libtorrent/session_params.hpp"
 #include "libtorrent/torrent_info.hpp"
 #include "libtorrent/version.hpp"
 #include "libtorrent/write_resume_data.hpp"
 
 #include "exceptions.h"
+#include "memory_storage.h"
+#include "streaming_plugin.h"
 #include "utils/enum_fmt.h"
 #include "utils/ifaces.h"
 #include "utils/log.h"
@@ -21,13 +28,22 @@
 #include "version.h"
 
 #define EXT_PARTS ".parts"
-#define EXT_TORRENT ".torrent"
-#define EXT_MAGNET ".magnet"
-#define EXT_FASTRESUME ".fastresume"
+#define SESSION_STATE_FILE "session.state"
+#define UPLOADS_DIR ".uploads"
 #define IF_AUTO_PREFIX "auto:"
 #define MAX_FILES_PER_TORRENT 1000
 #define MAX_SINGLE_CORE_CONNECTIONS 50
 #define DEFAULT_CONNECTIONS 200
+#define PROGRESS_INTERVAL 1
+#define PIECE_CLEANUP_INTERVAL 2
+#define RESUME_DATA_INTERVAL 1
+#define MAX_RESUME_DATA_REQUESTS 8
+#define RESUME_DATA_TIMEOUT 60
+#define MAX_PENDING_TORRENTS 256
+#define PENDING_WAIT_TIMEOUT 30
+#define SESSION_STATE_INTERVAL 300
+#define DEADLINE_CHECK_INTERVAL 1
+#define READ_POSITIONS_INTERVAL 15
 #define DEFAULT_DHT_BOOTSTRAP_NODES "router.utorrent.com:6881" \
                                     ",router.bittorrent.com:6881" \
                                     ",dht.transmissionbt.com:6881" \
@@ -38,9 +54,13 @@
 #if TORRENT_ABI_VERSION <= 2
 #define INFO_HASH_PARAM info_hash
 #define INFO_HASH_T libtorrent::sha1_hash
+#define SESSION_STATE_FLAGS libtorrent::session_handle::save_dht_state
 #else
 #define INFO_HASH_PARAM info_hashes
 #define INFO_HASH_T libtorrent::info_hash_t
+#define SESSION_STATE_FLAGS (libtorrent::session_handle::save_dht_state \
+                             | libtorrent::session_handle::save_extension_state \
+                             | libtorrent::session_handle::save_ip_filter)
 #endif
 
 namespace {
@@ -59,6 +79,12 @@ namespace {
         return ss.str();
     }
 
+    std::string get_info_hash(const libtorrent::add_torrent_params &pTorrentParams) {
+        return pTorrentParams.ti != nullptr && pTorrentParams.ti->is_valid()
+               ? get_info_hash(pTorrentParams.ti->INFO_HASH_PARAM())
+               : get_info_hash(pTorrentParams.INFO_HASH_PARAM);
+    }
+
     bool seed_time_reached(int pSeedTimeLimit, const std::chrono::seconds &pSeedingTime) {
         return pSeedTimeLimit > 0 && pSeedingTime >= std::chrono::seconds(pSeedTimeLimit);
     }
@@ -77,6 +103,23 @@ namespace {
                && pAllTimeUpload * 100 / pAllTimeDownload >= pShareRatioLimit;
     }
 
+    torrest::bittorrent::BandwidthClass get_bandwidth_class(bool pStreaming,
+                                                            bool pBuffering,
+                                                            const libtorrent::torrent_status &pStatus) {
+        if (pStreaming) {
+            return torrest::bittorrent::bc_streaming;
+        } else if (pBuffering) {
+            return torrest::bittorrent::bc_buffering;
+        } else if (pStatus.is_seeding || pStatus.is_finished) {
+            return torrest::bittorrent::bc_seeding;
+        }
+        return torrest::bittorrent::bc_background;
+    }
+
+    int get_class_rate_limit(int pRateLimit, int pTorrents) {
+        return pRateLimit > 0 && pTorrents > 0 ? std::max(1, pRateLimit / pTorrents) : 0;
+    }
+
 }
 
 namespace torrest { namespace bittorrent {
@@ -103,121 +146,392 @@ namespace torrest { namespace bittorrent {
         return is;
     }
 
+    struct ReadPositions {
+        std::map<int, std::int64_t> positions;
+    };
+
+    std::ostream &operator<<(std::ostream &os, const ReadPositions &pReadPositions) {
+        auto size = pReadPositions.positions.size();
+        os.write(reinterpret_cast<const char *>(&size), sizeof(size));
+        for (auto &position : pReadPositions.positions) {
+            os.write(reinterpret_cast<const char *>(&position.first), sizeof(position.first));
+            os.write(reinterpret_cast<const char *>(&position.second), sizeof(position.second));
+        }
+        return os;
+    }
+
+    std::istream &operator>>(std::istream &is, ReadPositions &pReadPositions) {
+        std::map<int, std::int64_t>::size_type size = 0;
+        is.read(reinterpret_cast<char *>(&size), sizeof(size));
+        for (decltype(size) i = 0; i < size && is; i++) {
+            int index;
+            std::int64_t offset;
+            is.read(reinterpret_cast<char *>(&index), sizeof(index));
+            is.read(reinterpret_cast<char *>(&offset), sizeof(offset));
+            if (is) {
+                pReadPositions.positions[index] = offset;
+            }
+        }
+        return is;
+    }
+
+    struct TorrentFileEntry {
+        TorrentRecord record;
+        libtorrent::add_torrent_params params;
+        std::string info_hash;
+        std::string error;
+        bool download{};
+    };
+
+    void parse_torrent_file_entry(TorrentFileEntry &pEntry) {
+        libtorrent::error_code errorCode;
+
+        try {
+            auto &buffer = pEntry.record.data;
+
+            switch (pEntry.record.type) {
+                case tr_fast_resume:
+                    pEntry.params = libtorrent::read_resume_data(buffer, errorCode);
+                    pEntry.download = true;
+                    break;
+                case tr_torrent:
+                    pEntry.params.ti = std::make_shared<libtorrent::torrent_info>(
+                            buffer.data(), int(buffer.size()), errorCode);
+                    break;
+                case tr_magnet: {
+                    Magnet magnet;
+                    std::istringstream is(std::string(buffer.begin(), buffer.end()));
+                    is >> magnet;
+                    libtorrent::parse_magnet_uri(magnet.magnet, pEntry.params, errorCode);
+                    pEntry.download = magnet.download;
+                    break;
+                }
+                default:
+                    throw std::invalid_argument("Invalid record type");
+            }
+        } catch (const std::exception &e) {
+            pEntry.error = e.what();
+            return;
+        }
+
+        if (errorCode.failed()) {
+            pEntry.error = errorCode.message();
+        } else {
+            pEntry.info_hash = get_info_hash(pEntry.params);
+        }
+
+        // The raw data is no longer needed
+        std::vector<char>().swap(pEntry.record.data);
+    }
+
     Service::Service(const settings::Settings &pSettings)
             : mLogger(utils::create_logger("bittorrent")),
               mAlertsLogger(utils::create_logger("alerts")),
-              mIsRunning(true),
+              mResumeDataCursor(0),
               mDownloadRate(0),
               mUploadRate(0),
               mProgress(0),
               mRateLimited(true) {
 
         mSettings = std::make_shared<ServiceSettings>(pSettings);
-        mSession = std::make_shared<libtorrent::session>(configure(pSettings)
-#if TORRENT_ABI_VERSION <= 2
-                , libtorrent::session::add_default_plugins
-#endif
-        );
+        mPersistenceQueue = std::make_shared<PersistenceQueue>(mLogger);
+        mSession = create_session(pSettings);
+        mStore = open_torrent_store(pSettings, mSettings, mPersistenceQueue, mLogger);
+        clean_uploads();
 
-        load_torrent_files();
+        register_alert_handlers();
+        start_event_loop();
 
-        mThreads.emplace_back(&Service::check_save_resume_data_handler, this);
-        mThreads.emplace_back(&Service::consume_alerts_handler, this);
-        mThreads.emplace_back(&Service::progress_handler, this);
-#if !TORREST_LEGACY_READ_PIECE
-        mThreads.emplace_back(&Service::piece_cleanup_handler, this);
-#endif
+        // Torrents are loaded in the background, so the service is usable right away
+        mLoaderThread = std::thread(&Service::load_torrent_files, this);
     }
 
     Service::~Service() {
-        mIsRunning = false;
-        mCv.notify_all();
-        for (auto &thread : mThreads) {
-            thread.join();
+        if (mLoaderThread.joinable()) {
+            mLoaderThread.join();
         }
+        mSession->set_alert_notify([] {});
+        mEventLoop->stop();
+        save_session_state();
+        save_read_positions();
+        // Wait for pending writes to be persisted
+        mStore.reset();
+        mPersistenceQueue.reset();
     }
 
-    void Service::check_save_resume_data_handler() const {
-        mLogger->debug("operation=check_save_resume_data_handler, message='Initializing handler'");
+    void Service::start_event_loop() {
+        mEventLoop = std::make_shared<EventLoop>(mLogger);
+        mEventLoop->set_event_handler([this] { consume_alerts(); });
+        mEventLoop->schedule(
+                "check_save_resume_data",
+                [] { return std::chrono::seconds(RESUME_DATA_INTERVAL); },
+                [this] { check_save_resume_data(); });
+        mEventLoop->schedule(
+                "update_progress",
+                [] { return std::chrono::seconds(PROGRESS_INTERVAL); },
+                [this] {
+                    if (!mSession->is_paused()) {
+                        update_progress();
+                    }
+                });
+#if !TORREST_LEGACY_READ_PIECE
+        mEventLoop->schedule(
+                "cleanup_pieces",
+                [] { return std::chrono::seconds(PIECE_CLEANUP_INTERVAL); },
+                [this] { cleanup_pieces(); });
+#endif
+        mEventLoop->schedule(
+                "check_deadlines",
+                [] { return std::chrono::seconds(DEADLINE_CHECK_INTERVAL); },
+                [this] { check_deadlines(); });
+        mEventLoop->schedule(
+                "save_read_positions",
+                [] { return std::chrono::seconds(READ_POSITIONS_INTERVAL); },
+                [this] { save_read_positions(); });
+        mEventLoop->schedule(
+                "save_session_state",
+                [] { return std::chrono::seconds(SESSION_STATE_INTERVAL); },
+                [this] { save_session_state(); });
+
+        // libtorrent calls this from its own thread, so it must only wake up the event loop
+        mSession->set_alert_notify([this] { mEventLoop->notify(); });
+        mEventLoop->start();
+        // Alerts posted before setting the notify function do not trigger a notification
+        mEventLoop->notify();
+    }
 
-        while (!wait_for_abort(mSettings->get_session_save())) {
-            if (!mTorrents.empty()) {
-                std::lock_guard<std::mutex> lock(mTorrentsMutex);
-                for (auto &torrent : mTorrents) {
-                    torrent->check_save_resume_data();
-                }
+    std::shared_ptr<libtorrent::session> Service::create_session(const settings::Settings &pSettings) {
+        auto settingsPack = configure(pSettings);
+        auto path = get_session_state_file();
+        std::vector<char> state;
+
+        if (boost::filesystem::exists(path)) {
+            mLogger->debug("operation=create_session, message='Loading session state', path='{}'", path);
+            try {
+                state = utils::read_file(path);
+            } catch (const std::exception &e) {
+                mLogger->error("operation=create_session, message='Failed reading session state', what='{}'",
+                               e.what());
             }
         }
 
-        mLogger->debug("operation=check_save_resume_data_handler, message='Terminating handler'");
+#if TORRENT_ABI_VERSION <= 2
+        auto session = std::make_shared<libtorrent::session>(settingsPack, libtorrent::session::add_default_plugins);
+        if (!state.empty()) {
+            libtorrent::error_code errorCode;
+            libtorrent::bdecode_node node;
+            if (libtorrent::bdecode(state.data(), state.data() + state.size(), node, errorCode) == 0) {
+                session->load_state(node, SESSION_STATE_FLAGS);
+            } else {
+                mLogger->error("operation=create_session, message='Failed decoding session state', what='{}'",
+                               errorCode.message());
+            }
+        }
+        return session;
+#else
+        libtorrent::session_params params;
+        if (!state.empty()) {
+            try {
+                params = libtorrent::read_session_params(state, SESSION_STATE_FLAGS);
+            } catch (const std::exception &e) {
+                mLogger->error("operation=create_session, message='Failed decoding session state', what='{}'",
+                               e.what());
+            }
+        }
+        params.settings = settingsPack;
+        return std::make_shared<libtorrent::session>(std::move(params));
+#endif
     }
 
-    void Service::consume_alerts_handler() const {
-        mLogger->debug("operation=consume_alerts_handler, message='Initializing handler'");
-        libtorrent::seconds alertWaitTime{1};
+    void Service::save_session_state() const {
+        mLogger->debug("operation=save_session_state, message='Saving session state'");
+#if TORRENT_ABI_VERSION <= 2
+        libtorrent::entry state;
+        mSession->save_state(state, SESSION_STATE_FLAGS);
+        std::vector<char> buffer;
+        libtorrent::bencode(std::back_inserter(buffer), state);
+#else
+        auto buffer = libtorrent::write_session_params_buf(
+                mSession->session_state(SESSION_STATE_FLAGS), SESSION_STATE_FLAGS);
+#endif
+
+        auto path = get_session_state_file();
+        mPersistenceQueue->enqueue(path, [path, buffer = std::move(buffer)] { utils::write_file(path, buffer); });
+    }
 
-        while (mIsRunning.load()) {
-            if (mSession->wait_for_alert(alertWaitTime) == nullptr) {
-                continue;
+    void Service::check_save_resume_data() {
+        mLogger->trace("operation=check_save_resume_data");
+        std::lock_guard<std::mutex> lock(mTorrentsMutex);
+        if (mTorrents.empty()) {
+            return;
+        }
+
+        // Spread the checks over the session save interval, so that every torrent is checked once per
+        // interval, while limiting the number of save resume data requests in flight
+        auto sessionSave = std::max(mSettings->load()->session_save, RESUME_DATA_INTERVAL);
+        auto batchSize = (mTorrents.size() * RESUME_DATA_INTERVAL + sessionSave - 1) / sessionSave;
+        auto now = std::chrono::steady_clock::now();
+        expire_resume_data_requests(now - std::chrono::seconds(RESUME_DATA_TIMEOUT));
+
+        for (std::size_t i = 0; i < batchSize && mResumeDataRequests.size() < MAX_RESUME_DATA_REQUESTS; i++) {
+            auto &torrent = mTorrents.at(mResumeDataCursor++ % mTorrents.size());
+            if (mResumeDataRequests.count(torrent->mInfoHash) == 0 && torrent->check_save_resume_data()) {
+                mResumeDataRequests.emplace(torrent->mInfoHash, now);
             }
+        }
 
-            std::vector<libtorrent::alert *> alerts;
-            mSession->pop_alerts(&alerts);
+        mResumeDataCursor %= mTorrents.size();
+    }
 
-            for (auto alert : alerts) {
-                auto alertMessage = alert->message();
-                auto alertCategory = alert->category();
+    void Service::expire_resume_data_requests(const std::chrono::steady_clock::time_point &pRequestedBefore) {
+        // Requests whose alert was lost would otherwise hold an in flight slot forever
+        for (auto it = mResumeDataRequests.begin(); it != mResumeDataRequests.end();) {
+            if (it->second <= pRequestedBefore) {
+                mLogger->debug("operation=expire_resume_data_requests, message='Resume data request expired', "
+                               "infoHash={}", it->first);
+                auto torrent = find_torrent(it->first);
+                if (torrent != mTorrents.end()) {
+                    (*torrent)->mResumeDataDirty = true;
+                }
+                it = mResumeDataRequests.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
 
-                switch (alert->type()) {
-                    case libtorrent::save_resume_data_alert::alert_type:
-                        handle_save_resume_data(dynamic_cast<const libtorrent::save_resume_data_alert *>(alert));
-                        break;
-                    case libtorrent::external_ip_alert::alert_type: {
-                        auto ip = dynamic_cast<const libtorrent::external_ip_alert *>(alert)->external_address.to_string();
-                        boost::algorithm::replace_all(alertMessage, ip, utils::sanitize_ip_address(ip));
-                        break;
-                    }
-                    case libtorrent::metadata_received_alert::alert_type:
-                        handle_metadata_received(dynamic_cast<const libtorrent::metadata_received_alert *>(alert));
-                        break;
-                    case libtorrent::state_changed_alert::alert_type:
-                        handle_state_changed(dynamic_cast<const libtorrent::state_changed_alert *>(alert));
-                        break;
+    void Service::register_alert_handlers() {
+        mAlertDispatcher.subscribe<libtorrent::save_resume_data_alert>(
+                [this](const libtorrent::save_resume_data_alert *pAlert) { handle_save_resume_data(pAlert); });
+        mAlertDispatcher.subscribe<libtorrent::save_resume_data_failed_alert>(
+                [this](const libtorrent::save_resume_data_failed_alert *pAlert) {
+                    handle_save_resume_data_failed(pAlert);
+                });
+        mAlertDispatcher.subscribe<libtorrent::add_torrent_alert>(
+                [this](const libtorrent::add_torrent_alert *pAlert) { handle_add_torrent(pAlert); });
+        mAlertDispatcher.subscribe<libtorrent::metadata_received_alert>(
+                [this](const libtorrent::metadata_received_alert *pAlert) { handle_metadata_received(pAlert); });
+        mAlertDispatcher.subscribe<libtorrent::state_changed_alert>(
+                [this](const libtorrent::state_changed_alert *pAlert) { handle_state_changed(pAlert); });
+        mAlertDispatcher.subscribe<libtorrent::piece_finished_alert>(
+                [this](const libtorrent::piece_finished_alert *pAlert) { handle_piece_finished(pAlert); });
+        mAlertDispatcher.subscribe<libtorrent::block_finished_alert>(
+                [this](const libtorrent::block_finished_alert *pAlert) { handle_block_finished(pAlert); });
+        mAlertDispatcher.subscribe<libtorrent::hash_failed_alert>(
+                [this](const libtorrent::hash_failed_alert *pAlert) { handle_hash_failed(pAlert); });
+        mAlertDispatcher.subscribe<libtorrent::alerts_dropped_alert>(
+                [this](const libtorrent::alerts_dropped_alert *pAlert) { handle_alerts_dropped(pAlert); });
+        mAlertDispatcher.subscribe<libtorrent::torrent_removed_alert>(
+                [this](const libtorrent::torrent_removed_alert *pAlert) { handle_torrent_removed(pAlert); });
+        mAlertDispatcher.subscribe<libtorrent::torrent_deleted_alert>(
+                [this](const libtorrent::torrent_deleted_alert *pAlert) { handle_torrent_deleted(pAlert); });
+        mAlertDispatcher.subscribe<libtorrent::torrent_delete_failed_alert>(
+                [this](const libtorrent::torrent_delete_failed_alert *pAlert) {
+                    handle_torrent_delete_failed(pAlert);
+                });
 #if !TORREST_LEGACY_READ_PIECE
-                    case libtorrent::read_piece_alert::alert_type:
-                        handle_read_piece_alert(dynamic_cast<const libtorrent::read_piece_alert *>(alert));
-                        break;
+        mAlertDispatcher.subscribe<libtorrent::read_piece_alert>(
+                [this](const libtorrent::read_piece_alert *pAlert) { handle_read_piece_alert(pAlert); });
 #endif
-                }
+    }
 
-                spdlog::level::level_enum level;
-                if (alertCategory & libtorrent::alert::error_notification) {
-                    level = spdlog::level::err;
-                } else if (alertCategory & libtorrent::alert::connect_notification) {
-                    level = spdlog::level::debug;
-                } else if (alertCategory & libtorrent::alert::performance_warning) {
-                    level = spdlog::level::warn;
-                } else {
-                    level = spdlog::level::info;
-                }
+    void Service::consume_alerts() const {
+        std::vector<libtorrent::alert *> alerts;
+        mSession->pop_alerts(&alerts);
 
-                mAlertsLogger->log(
-                        level, "operation=consume_alerts_handler, type={}, what='{}', message='{}'",
-                        alert->type(), alert->what(), alertMessage);
-            }
+        for (auto alert : alerts) {
+            mAlertDispatcher.dispatch(alert);
+            log_alert(alert);
+        }
+    }
+
+    void Service::log_alert(const libtorrent::alert *pAlert) const {
+        auto alertCategory = pAlert->category();
+        spdlog::level::level_enum level;
+
+        if (alertCategory & libtorrent::alert::error_notification) {
+            level = spdlog::level::err;
+        } else if (alertCategory & libtorrent::alert::connect_notification) {
+            level = spdlog::level::debug;
+        } else if (alertCategory & libtorrent::alert::performance_warning) {
+            level = spdlog::level::warn;
+        } else if (alertCategory & (libtorrent::alert::piece_progress_notification
+                                    | libtorrent::alert::block_progress_notification)) {
+            level = spdlog::level::trace;
+        } else {
+            level = spdlog::level::info;
         }
 
-        mLogger->debug("operation=consume_alerts_handler, message='Terminating handler'");
+        // Only format the alert message if it is going to be logged
+        if (!mAlertsLogger->should_log(level)) {
+            return;
+        }
+
+        auto alertMessage = pAlert->message();
+        if (auto externalIpAlert = libtorrent::alert_cast<libtorrent::external_ip_alert>(pAlert)) {
+            auto ip = externalIpAlert->external_address.to_string();
+            boost::algorithm::replace_all(alertMessage, ip, utils::sanitize_ip_address(ip));
+        }
+
+        mAlertsLogger->log(
+                level, "operation=consume_alerts, type={}, what='{}', message='{}'",
+                pAlert->type(), pAlert->what(), alertMessage);
     }
 
-    void Service::handle_save_resume_data(const libtorrent::save_resume_data_alert *pAlert) const {
+    void Service::handle_save_resume_data(const libtorrent::save_resume_data_alert *pAlert) {
         auto infoHash = get_info_hash(pAlert->handle.INFO_HASH_PARAM());
         mLogger->debug("operation=handle_save_resume_data, message='Saving resume data', infoHash={}", infoHash);
 
-        auto buffer = libtorrent::write_resume_data_buf(pAlert->params);
-        std::ofstream of(get_fast_resume_file(infoHash), std::ios::binary);
-        of.unsetf(std::ios::skipws);
-        of.write(buffer.data(), int(buffer.size()));
+        {
+            std::lock_guard<std::mutex> lock(mTorrentsMutex);
+            mResumeDataRequests.erase(infoHash);
+        }
+
+        mStore->save(tr_fast_resume, infoHash, [buffer = libtorrent::write_resume_data_buf(pAlert->params)] {
+            return buffer;
+        });
+    }
+
+    void Service::handle_save_resume_data_failed(const libtorrent::save_resume_data_failed_alert *pAlert) {
+        auto infoHash = get_info_hash(pAlert->handle.INFO_HASH_PARAM());
+        mLogger->debug("operation=handle_save_resume_data_failed, message='{}', infoHash={}",
+                       pAlert->error.message(), infoHash);
+
+        std::lock_guard<std::mutex> lock(mTorrentsMutex);
+        mResumeDataRequests.erase(infoHash);
+    }
+
+    void Service::handle_add_torrent(const libtorrent::add_torrent_alert *pAlert) {
+        auto infoHash = pAlert->handle.is_valid()
+                        ? get_info_hash(pAlert->handle.INFO_HASH_PARAM())
+                        : get_info_hash(pAlert->params);
+
+        std::lock_guard<std::mutex> lock(mTorrentsMutex);
+        auto it = mPendingTorrents.find(infoHash);
+        if (it == mPendingTorrents.end()) {
+            // Torrent was added synchronously
+            return;
+        }
+
+        if (pAlert->error.failed()) {
+            mLogger->error("operation=handle_add_torrent, message='Failed adding torrent', what='{}', infoHash={}",
+                           pAlert->error.message(), infoHash);
+            if (!it->second.key.empty() && pAlert->error != libtorrent::errors::duplicate_torrent) {
+                mStore->remove(it->second.type, it->second.key);
+            }
+        } else {
+            mLogger->debug("operation=handle_add_torrent, message='Torrent added', infoHash={}", infoHash);
+            auto torrent = std::make_shared<Torrent>(mSettings, pAlert->handle, infoHash, it->second.download,
+                                                     it->second.plugin, it->second.memory_buffer, mLogger);
+            restore_read_positions(torrent);
+            if (pAlert->params.ti != nullptr && pAlert->params.ti->is_valid()) {
+                torrent->handle_metadata_received();
+            }
+            mTorrents.emplace_back(torrent);
+        }
+
+        mPendingTorrents.erase(it);
+        mPendingCv.notify_all();
     }
 
     void Service::handle_metadata_received(const libtorrent::metadata_received_alert *pAlert) const {
@@ -225,7 +539,11 @@ namespace torrest { namespace bittorrent {
         auto infoHash = get_info_hash(torrentFile->INFO_HASH_PARAM());
 
         try {
-            get_torrent(infoHash)->handle_metadata_received();
+            auto torrent = get_active_torrent(infoHash);
+            torrent->handle_metadata_received();
+            if (torrent->is_memory_storage()) {
+                return;
+            }
         } catch (const std::exception &e) {
             mLogger->error(
                     "operation=handle_metadata_received, message='Failed handling metadata', infoHash={}, what='{}'",
@@ -233,22 +551,30 @@ namespace torrest { namespace bittorrent {
         }
 
         mLogger->debug("operation=handle_metadata_received, message='Saving torrent file', infoHash={}", infoHash);
-        std::vector<char> buffer;
-        libtorrent::create_torrent t(*torrentFile);
-        libtorrent::bencode(std::back_inserter(buffer), t.generate());
-        std::ofstream of(get_torrent_file(infoHash), std::ios::binary);
-        of.unsetf(std::ios::skipws);
-        of.write(buffer.data(), int(buffer.size()));
-
-        mLogger->debug("operation=handle_metadata_received, message='Deleting magnet file', infoHash={}", infoHash);
-        delete_magnet_file(infoHash);
+        mStore->save(tr_torrent, infoHash, [torrentFile] {
+            std::vector<char> buffer;
+            libtorrent::create_torrent t(*torrentFile);
+            libtorrent::bencode(std::back_inserter(buffer), t.generate());
+            return buffer;
+        });
+        mStore->remove(tr_magnet, infoHash);
     }
 
     void Service::handle_state_changed(const libtorrent::state_changed_alert *pAlert) const {
-        if (mSettings->get_check_available_space() && pAlert->state == libtorrent::torrent_status::downloading) {
+        {
+            // Pieces may have been checked without being reported, so the buffering progress must be recomputed
+            std::lock_guard<std::mutex> lock(mTorrentsMutex);
+            auto it = find_torrent(get_info_hash(pAlert->handle.INFO_HASH_PARAM()));
+            if (it != mTorrents.end()) {
+                (*it)->invalidate_buffering_state();
+            }
+        }
+
+        auto settings = mSettings->load();
+        if (settings->check_available_space && pAlert->state == libtorrent::torrent_status::downloading) {
             auto infoHash = get_info_hash(pAlert->handle.INFO_HASH_PARAM());
             try {
-                get_torrent(infoHash)->check_available_space(mSettings->get_download_path());
+                get_active_torrent(infoHash)->check_available_space(settings->download_path);
             } catch (const std::exception &e) {
                 mLogger->error("operation=handle_state_changed, message='Failed handling state change', what='{}'",
                                e.what());
@@ -256,6 +582,78 @@ namespace torrest { namespace bittorrent {
         }
     }
 
+    void Service::handle_piece_finished(const libtorrent::piece_finished_alert *pAlert) const {
+        std::lock_guard<std::mutex> lock(mTorrentsMutex);
+        auto it = find_torrent(get_info_hash(pAlert->handle.INFO_HASH_PARAM()));
+        if (it != mTorrents.end()) {
+            (*it)->handle_piece_finished(pAlert->piece_index);
+        }
+    }
+
+    void Service::handle_block_finished(const libtorrent::block_finished_alert *pAlert) const {
+        // Block alerts are very frequent, so ignore them unless there are files buffering
+        if (!mHasFilesBuffering.load()) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mTorrentsMutex);
+        auto it = find_torrent(get_info_hash(pAlert->handle.INFO_HASH_PARAM()));
+        if (it != mTorrents.end()) {
+            (*it)->handle_block_finished(pAlert->piece_index, pAlert->block_index);
+        }
+    }
+
+    void Service::handle_hash_failed(const libtorrent::hash_failed_alert *pAlert) const {
+        std::lock_guard<std::mutex> lock(mTorrentsMutex);
+        auto it = find_torrent(get_info_hash(pAlert->handle.INFO_HASH_PARAM()));
+        if (it != mTorrents.end()) {
+            (*it)->handle_hash_failed(pAlert->piece_index);
+        }
+    }
+
+    void Service::handle_alerts_dropped(const libtorrent::alerts_dropped_alert *pAlert) {
+        mLogger->warn("operation=handle_alerts_dropped, message='Alerts were dropped, recomputing buffering state'");
+        std::lock_guard<std::mutex> lock(mTorrentsMutex);
+        for (auto &torrent : mTorrents) {
+            torrent->invalidate_buffering_state();
+        }
+        // The save resume data alerts may have been dropped as well, so the requests are made again
+        expire_resume_data_requests(std::chrono::steady_clock::now());
+    }
+
+    void Service::handle_torrent_removed(const libtorrent::torrent_removed_alert *pAlert) {
+        auto infoHash = get_info_hash(pAlert->INFO_HASH_PARAM);
+        std::lock_guard<std::mutex> lock(mTorrentsMutex);
+        auto it = mRemovals.find(infoHash);
+        if (it != mRemovals.end()) {
+            if (!it->second.delete_files) {
+                mLogger->debug("operation=handle_torrent_removed, message='Torrent removed', infoHash={}", infoHash);
+                mRemovals.erase(it);
+            } else if (it->second.state == rs_removing) {
+                it->second.state = rs_deleting_files;
+            }
+        }
+    }
+
+    void Service::handle_torrent_deleted(const libtorrent::torrent_deleted_alert *pAlert) {
+        auto infoHash = get_info_hash(pAlert->INFO_HASH_PARAM);
+        mLogger->debug("operation=handle_torrent_deleted, message='Torrent files deleted', infoHash={}", infoHash);
+        std::lock_guard<std::mutex> lock(mTorrentsMutex);
+        mRemovals.erase(infoHash);
+    }
+
+    void Service::handle_torrent_delete_failed(const libtorrent::torrent_delete_failed_alert *pAlert) {
+        auto infoHash = get_info_hash(pAlert->INFO_HASH_PARAM);
+        mLogger->error("operation=handle_torrent_delete_failed, message='Failed deleting torrent files', "
+                       "infoHash={}, what='{}'", infoHash, pAlert->error.message());
+        std::lock_guard<std::mutex> lock(mTorrentsMutex);
+        auto it = mRemovals.find(infoHash);
+        if (it != mRemovals.end()) {
+            it->second.failed = true;
+            it->second.error = pAlert->error.message();
+            it->second.state = rs_failed;
+        }
+    }
+
 #if !TORREST_LEGACY_READ_PIECE
 
     void Service::handle_read_piece_alert(const libtorrent::read_piece_alert *pAlert) const {
@@ -264,9 +662,15 @@ namespace torrest { namespace bittorrent {
             mLogger->error(
                     "operation=handle_read_piece_alert, message='Failed reading piece', infoHash={}, piece={}, error={}",
                     infoHash, to_string(pAlert->piece), pAlert->error.message());
+            try {
+                get_active_torrent(infoHash)->fail_piece(pAlert->piece);
+            } catch (const std::exception &e) {
+                mLogger->error("operation=handle_read_piece_alert, message='Failed handling read piece', what='{}'",
+                               e.what());
+            }
         } else {
             try {
-                get_torrent(infoHash)->store_piece(pAlert->piece, pAlert->size, pAlert->buffer);
+                get_active_torrent(infoHash)->store_piece(pAlert->piece, pAlert->size, pAlert->buffer);
             } catch (const std::exception &e) {
                 mLogger->error("operation=handle_read_piece_alert, message='Failed handling read piece', what='{}'",
                                e.what());
@@ -274,33 +678,31 @@ namespace torrest { namespace bittorrent {
         }
     }
 
-    void Service::piece_cleanup_handler() const {
-        mLogger->debug("operation=piece_cleanup_handler, message='Initializing handler'");
-
-        while (!wait_for_abort(2)) {
-            if (!mTorrents.empty()) {
-                std::lock_guard<std::mutex> lock(mTorrentsMutex);
-                for (auto &torrent : mTorrents) {
-                    torrent->cleanup_pieces(std::chrono::seconds(mSettings->get_piece_expiration()));
-                }
-            }
+    void Service::cleanup_pieces() const {
+        auto expiration = std::chrono::seconds(mSettings->load()->piece_expiration);
+        std::lock_guard<std::mutex> lock(mTorrentsMutex);
+        for (auto &torrent : mTorrents) {
+            torrent->cleanup_pieces(expiration);
         }
-
-        mLogger->debug("operation=piece_cleanup_handler, message='Terminating handler'");
     }
 
 #endif //TORREST_LEGACY_READ_PIECE
 
-    void Service::progress_handler() {
-        mLogger->debug("operation=progress_handler, message='Initializing handler'");
-
-        while (!wait_for_abort(1)) {
-            if (!mSession->is_paused()) {
-                update_progress();
+    void Service::check_deadlines() const {
+        // Deadlines are checked without holding the torrents lock, as they query libtorrent
+        std::vector<std::shared_ptr<Torrent>> torrents;
+        {
+            std::lock_guard<std::mutex> lock(mTorrentsMutex);
+            for (auto &torrent : mTorrents) {
+                if (!torrent->mPaused.load() && torrent->mHasMetadata.load() && torrent->mHandle.is_valid()) {
+                    torrents.push_back(torrent);
+                }
             }
         }
 
-        mLogger->debug("operation=progress_handler, message='Terminating handler'");
+        for (auto &torrent : torrents) {
+            torrent->check_deadlines();
+        }
     }
 
     void Service::update_progress() {
@@ -309,6 +711,10 @@ namespace torrest { namespace bittorrent {
         std::int64_t total_wanted_done = 0;
         std::int64_t total_wanted = 0;
         bool has_files_buffering = false;
+        int active_seeds = 0;
+        int class_torrents[bc_seeding + 1] = {};
+        std::vector<std::pair<std::shared_ptr<Torrent>, BandwidthClass>> bandwidth_classes;
+        auto settings = mSettings->load();
 
         std::unique_lock<std::mutex> lock(mTorrentsMutex);
         for (auto &torrent : mTorrents) {
@@ -317,7 +723,8 @@ namespace torrest { namespace bittorrent {
             }
 
             // Check torrent buffering state
-            if (torrent->verify_buffering_state()) {
+            auto is_buffering = torrent->verify_buffering_state();
+            if (is_buffering) {
                 has_files_buffering = true;
             }
 
@@ -325,6 +732,19 @@ namespace torrest { namespace bittorrent {
             total_download_rate += status.download_rate;
             total_upload_rate += status.upload_rate;
 
+            auto bandwidth_class = get_bandwidth_class(torrent->has_readers(), is_buffering, status);
+            class_torrents[bandwidth_class]++;
+            bandwidth_classes.emplace_back(torrent, bandwidth_class);
+
+            // Activated seeds are counted while checking or queued, otherwise more would be activated meanwhile
+            auto is_activating = mActivatingSeeds.count(torrent->mInfoHash) > 0;
+            if ((status.is_finished || is_activating) && !(status.flags & libtorrent::torrent_flags::paused)) {
+                active_seeds++;
+            }
+            if (is_activating && status.is_finished) {
+                mActivatingSeeds.erase(torrent->mInfoHash);
+            }
+
             if (status.progress < 1) {
                 total_wanted += status.total_wanted;
                 total_wanted_done += status.total_wanted_done;
@@ -333,16 +753,16 @@ namespace torrest { namespace bittorrent {
                                     ? status.finished_duration : status.seeding_duration;
                 auto download_time = status.active_duration - seeding_time;
 
-                if (seed_time_reached(mSettings->get_seed_time_limit(), seeding_time)) {
+                if (seed_time_reached(settings->seed_time_limit, seeding_time)) {
                     mLogger->info("operation=update_progress, message='Seeding time limit reached', infoHash={}",
                                   torrent->mInfoHash);
                     torrent->pause();
-                } else if (seed_time_ratio_reached(mSettings->get_seed_time_ratio_limit(), download_time,
+                } else if (seed_time_ratio_reached(settings->seed_time_ratio_limit, download_time,
                                                    seeding_time)) {
                     mLogger->info("operation=update_progress, message='Seeding time ratio reached', infoHash={}",
                                   torrent->mInfoHash);
                     torrent->pause();
-                } else if (share_ratio_reached(mSettings->get_share_ratio_limit(), status.all_time_download,
+                } else if (share_ratio_reached(settings->share_ratio_limit, status.all_time_download,
                                                status.all_time_upload)) {
                     mLogger->info("operation=update_progress, message='Share ratio reached', infoHash={}",
                                   torrent->mInfoHash);
@@ -351,9 +771,58 @@ namespace torrest { namespace bittorrent {
             }
         }
 
+        // Background and seeding torrents are only throttled while there are active streams. This is best-effort,
+        // as libtorrent 1.2 peer classes can not be assigned per torrent, so class limits are split between torrents
+        auto is_streaming = class_torrents[bc_streaming] > 0 || class_torrents[bc_buffering] > 0;
+        auto background_download_limit = is_streaming ? get_class_rate_limit(
+                settings->max_background_rate, class_torrents[bc_background]) : 0;
+        auto seeding_upload_limit = is_streaming ? get_class_rate_limit(
+                settings->max_seeding_rate, class_torrents[bc_seeding]) : 0;
+
+        for (auto &entry : bandwidth_classes) {
+            auto is_streamed = entry.second == bc_streaming || entry.second == bc_buffering;
+            entry.first->set_bandwidth_class(
+                    entry.second,
+                    entry.second == bc_background ? background_download_limit : 0,
+                    entry.second == bc_seeding ? seeding_upload_limit : 0);
+            entry.first->set_stream_promotion(is_streamed);
+            // With a sequential window, readers request pieces in order themselves and the rest is rarest-first
+            entry.first->set_sequential_download(is_streamed && settings->sequential_window == 0);
+        }
+
+        for (auto it = mActivatingSeeds.begin(); it != mActivatingSeeds.end();) {
+            if (mPendingTorrents.find(*it) != mPendingTorrents.end()) {
+                active_seeds++;
+                ++it;
+            } else {
+                auto torrent = find_torrent(*it);
+                if (torrent == mTorrents.end() || (*torrent)->mPaused.load()) {
+                    it = mActivatingSeeds.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+
+        if (!mDormantTorrents.empty()) {
+            activate_dormant_seeds(active_seeds, settings->active_seeds_limit);
+        }
+
+        if (has_files_buffering && !mHasFilesBuffering.load()) {
+            // Blocks finished before block alerts get enabled are not accounted, so resync on the next update
+            for (auto &torrent : mTorrents) {
+                torrent->invalidate_buffering_state();
+            }
+        }
+
         lock.unlock();
         std::lock_guard<std::mutex> sLock(mServiceMutex);
-        set_buffering_rate_limits(!has_files_buffering);
+        auto buffering_changed = mHasFilesBuffering.exchange(has_files_buffering) != has_files_buffering;
+        auto streaming_changed = mIsStreaming.exchange(is_streaming) != is_streaming;
+        if (buffering_changed || streaming_changed) {
+            set_progress_alerts(is_streaming, has_files_buffering);
+        }
+        set_buffering_rate_limits(!is_streaming);
 
         mDownloadRate = total_download_rate;
         mUploadRate = total_upload_rate;
@@ -363,17 +832,38 @@ namespace torrest { namespace bittorrent {
 
     void Service::reconfigure(const settings::Settings &pSettings, bool pReset) {
         mLogger->debug("operation=reconfigure, message='Reconfiguring service', reset={}", pReset);
-        std::lock_guard<std::mutex> lock(mServiceMutex);
-
-        mLogger->info("operation=reconfigure, message='Applying session settings'");
-        mSession->apply_settings(configure(pSettings));
-        mSettings->update(pSettings);
-        mRateLimited |= !pSettings.limit_after_buffering;
+        // Concurrent resets would otherwise race on the loader thread. The service mutex can't be held
+        // for the whole reset, as the event loop needs it to handle the pending torrents being waited
+        std::lock_guard<std::mutex> resetLock(mResetMutex);
+
+        {
+            std::lock_guard<std::mutex> lock(mServiceMutex);
+            mLogger->info("operation=reconfigure, message='Applying session settings'");
+            mSession->apply_settings(configure(pSettings));
+            mSettings->update(pSettings);
+            mRateLimited |= !pSettings.limit_after_buffering;
+        }
 
         if (pReset) {
             mLogger->debug("operation=reconfigure, message='Resetting torrents'");
-            std::lock_guard<std::mutex> tLock(mTorrentsMutex);
-            remove_torrents();
+            if (mLoaderThread.joinable()) {
+                mLoaderThread.join();
+            }
+
+            {
+                // Pending torrents must be added before they can be removed
+                std::unique_lock<std::mutex> lock(mTorrentsMutex);
+                if (!mPendingCv.wait_for(lock, std::chrono::seconds(PENDING_WAIT_TIMEOUT),
+                                         [this] { return mPendingTorrents.empty(); })) {
+                    mLogger->error("operation=reconfigure, message='Timed out waiting for pending torrents', "
+                                   "pending={}", mPendingTorrents.size());
+                    throw LoadTorrentException("Timed out waiting for pending torrents");
+                }
+                remove_torrents();
+            }
+
+            mStore->flush();
+            mPersistenceQueue->flush();
             load_torrent_files();
         }
     }
@@ -381,6 +871,7 @@ namespace torrest { namespace bittorrent {
     libtorrent::settings_pack Service::configure(const settings::Settings &pSettings) {
         boost::filesystem::create_directory(pSettings.download_path);
         boost::filesystem::create_directory(pSettings.torrents_path);
+        boost::filesystem::create_directory(utils::join_path(pSettings.torrents_path, UPLOADS_DIR));
 
         mLogger->set_level(pSettings.service_log_level);
         mAlertsLogger->set_level(pSettings.alerts_log_level);
@@ -390,6 +881,11 @@ namespace torrest { namespace bittorrent {
                          ? "torrest/" TORREST_VERSION " libtorrent/" LIBTORRENT_VERSION
                          : pSettings.user_agent;
         mLogger->debug("operation=configure, userAgent='{}'", userAgent);
+#if TORRENT_ABI_VERSION > 2
+        if (pSettings.memory_storage_size > 0) {
+            mLogger->warn("operation=configure, message='Memory storage is not supported on libtorrent 2'");
+        }
+#endif
         settingsPack.set_str(libtorrent::settings_pack::user_agent, userAgent);
 
         // Default settings
@@ -561,10 +1057,7 @@ namespace torrest { namespace bittorrent {
         }
 
         settingsPack.set_int(libtorrent::settings_pack::alert_mask,
-                             libtorrent::alert::status_notification
-                             | libtorrent::alert::storage_notification
-                             | libtorrent::alert::performance_warning
-                             | libtorrent::alert::error_notification);
+                             get_alert_mask(mIsStreaming.load(), mHasFilesBuffering.load()));
 
         std::vector<std::string> listenInterfaces;
         auto listenPort = ":" + std::to_string(pSettings.listen_port);
@@ -634,14 +1127,34 @@ namespace torrest { namespace bittorrent {
         return settingsPack;
     }
 
+    libtorrent::alert_category_t Service::get_alert_mask(bool pPieceProgress, bool pBlockProgress) {
+        // Piece alerts are only needed to track deadline hits and buffering progress of streamed torrents,
+        // and block alerts to track the progress of the files being buffered
+        return libtorrent::alert::status_notification
+               | libtorrent::alert::storage_notification
+               | (pPieceProgress ? libtorrent::alert::piece_progress_notification : libtorrent::alert_category_t{})
+               | (pBlockProgress ? libtorrent::alert::block_progress_notification : libtorrent::alert_category_t{})
+               | libtorrent::alert::performance_warning
+               | libtorrent::alert::error_notification;
+    }
+
+    void Service::set_progress_alerts(bool pPieceProgress, bool pBlockProgress) {
+        mLogger->debug("operation=set_progress_alerts, pieceProgress={}, blockProgress={}",
+                       pPieceProgress, pBlockProgress);
+        libtorrent::settings_pack settingsPack;
+        settingsPack.set_int(libtorrent::settings_pack::alert_mask, get_alert_mask(pPieceProgress, pBlockProgress));
+        mSession->apply_settings(settingsPack);
+    }
+
     void Service::set_buffering_rate_limits(bool pEnable) {
-        if (mSettings->get_limit_after_buffering() && mRateLimited != pEnable) {
+        auto settings = mSettings->load();
+        if (settings->limit_after_buffering && mRateLimited != pEnable) {
             mLogger->debug("operation=set_buffering_rate_limits, enable={}", pEnable);
             libtorrent::settings_pack settingsPack;
             settingsPack.set_int(libtorrent::settings_pack::download_rate_limit,
-                                 pEnable ? mSettings->get_max_download_rate() : 0);
+                                 pEnable ? settings->max_download_rate : 0);
             settingsPack.set_int(libtorrent::settings_pack::upload_rate_limit,
-                                 pEnable ? mSettings->get_max_upload_rate() : 0);
+                                 pEnable ? settings->max_upload_rate : 0);
             mSession->apply_settings(settingsPack);
             mRateLimited = pEnable;
         }
@@ -653,30 +1166,26 @@ namespace torrest { namespace bittorrent {
             (*it)->mClosed = true;
             mSession->remove_torrent((*it)->mHandle);
         }
+        mDormantTorrents.clear();
+        mActivatingSeeds.clear();
+        mResumeDataRequests.clear();
     }
 
     void Service::add_torrent_with_params(libtorrent::add_torrent_params &pTorrentParams,
                                           const std::string &pInfoHash,
                                           bool pIsResumeData,
-                                          bool pDownload) {
+                                          bool pDownload,
+                                          bool pMemory) {
         mLogger->debug("operation=add_torrent_with_params, message='Adding torrent', infoHash={}", pInfoHash);
 
+        check_not_removing(pInfoHash);
         if (has_torrent(pInfoHash)) {
             throw DuplicateTorrentException("Torrent was previously added", pInfoHash);
         }
 
-        if (!pIsResumeData) {
-            mLogger->debug("operation=add_torrent_with_params, message='Setting params', infoHash={}", pInfoHash);
-            pTorrentParams.save_path = mSettings->get_download_path();
-            pTorrentParams.flags |= libtorrent::torrent_flags::sequential_download;
-        }
-
-        if (!pDownload) {
-            mLogger->debug("operation=add_torrent_with_params, message='Disabling download', infoHash={}", pInfoHash);
-            for (int i = MAX_FILES_PER_TORRENT; i > 0; i--) {
-                pTorrentParams.file_priorities.push_back(libtorrent::download_priority_t(0));
-            }
-        }
+        prepare_torrent_params(pTorrentParams, pInfoHash, pIsResumeData, pDownload);
+        auto plugin = StreamingPlugin::attach(pTorrentParams, pInfoHash, mLogger);
+        auto memoryBuffer = attach_memory_storage(pTorrentParams, pInfoHash, pMemory);
 
         libtorrent::error_code errorCode;
         auto handle = mSession->add_torrent(pTorrentParams, errorCode);
@@ -686,16 +1195,100 @@ namespace torrest { namespace bittorrent {
             throw LoadTorrentException(errorCode.message());
         }
 
-        auto torrent = std::make_shared<Torrent>(mSettings, handle, pInfoHash, mLogger);
+        auto torrent = std::make_shared<Torrent>(
+                mSettings, handle, pInfoHash, pDownload, plugin, memoryBuffer, mLogger);
+        restore_read_positions(torrent);
         if (pTorrentParams.ti != nullptr && pTorrentParams.ti->is_valid()) {
             torrent->handle_metadata_received();
         }
         mTorrents.emplace_back(torrent);
     }
 
-    std::string Service::add_magnet(const std::string &pMagnet, bool pDownload, bool pSaveMagnet) {
-        mLogger->debug("operation=add_magnet, message='Adding magnet', magnet='{}', download={}, saveMagnet={}",
-                       pMagnet, pDownload, pSaveMagnet);
+    void Service::check_memory_storage(bool pDownload, bool pMemory) const {
+        if (!pMemory) {
+            return;
+        }
+#if TORRENT_ABI_VERSION > 2
+        throw MemoryStorageException("Memory storage is not supported on libtorrent 2");
+#else
+        if (mSettings->load()->memory_storage_size <= 0) {
+            throw MemoryStorageException("Memory storage is disabled");
+        }
+        if (pDownload) {
+            throw MemoryStorageException("Torrents kept in memory can't be downloaded");
+        }
+#endif
+    }
+
+    std::shared_ptr<MemoryBuffer> Service::attach_memory_storage(libtorrent::add_torrent_params &pTorrentParams,
+                                                                 const std::string &pInfoHash,
+                                                                 bool pMemory) const {
+#if TORRENT_ABI_VERSION <= 2
+        // Torrents kept in memory are never persisted, so they are never loaded from resume data
+        if (pMemory) {
+            mLogger->debug("operation=attach_memory_storage, message='Using memory storage', infoHash={}", pInfoHash);
+            return MemoryStorage::attach(pTorrentParams, mSettings->load()->memory_storage_size, pInfoHash, mLogger);
+        }
+#endif
+        return nullptr;
+    }
+
+    void Service::prepare_torrent_params(libtorrent::add_torrent_params &pTorrentParams,
+                                         const std::string &pInfoHash,
+                                         bool pIsResumeData,
+                                         bool pDownload) const {
+        if (!pIsResumeData) {
+            mLogger->debug("operation=prepare_torrent_params, message='Setting params', infoHash={}", pInfoHash);
+            pTorrentParams.save_path = mSettings->load()->download_path;
+        }
+
+        // Sequential download is only enabled while the torrent is being streamed
+        pTorrentParams.flags &= ~libtorrent::torrent_flags::sequential_download;
+
+        // Streamed torrents are temporarily not auto managed, which must not outlive a restart
+        if (pIsResumeData && !(pTorrentParams.flags & libtorrent::torrent_flags::paused)) {
+            pTorrentParams.flags |= libtorrent::torrent_flags::auto_managed;
+        }
+
+        // Per torrent limits are managed by the bandwidth classes, so stale limits must not be restored
+        pTorrentParams.download_limit = -1;
+        pTorrentParams.upload_limit = -1;
+
+        if (!pDownload) {
+            // Without metadata the number of files is unknown, so the priorities are padded and libtorrent
+            // truncates them once it is received. Files past the padding are disabled by the torrent afterwards
+            mLogger->debug("operation=prepare_torrent_params, message='Disabling download', infoHash={}", pInfoHash);
+            auto numFiles = pTorrentParams.ti != nullptr && pTorrentParams.ti->is_valid()
+                            ? pTorrentParams.ti->num_files() : MAX_FILES_PER_TORRENT;
+            pTorrentParams.file_priorities.assign(numFiles, libtorrent::dont_download);
+        }
+    }
+
+    void Service::async_add_torrent_with_params(libtorrent::add_torrent_params &pTorrentParams,
+                                                const std::string &pInfoHash,
+                                                bool pIsResumeData,
+                                                bool pDownload,
+                                                bool pMemory,
+                                                TorrentRecordType pSourceType,
+                                                const std::string &pSourceKey) {
+        mLogger->debug("operation=async_add_torrent_with_params, message='Adding torrent', infoHash={}", pInfoHash);
+
+        check_not_removing(pInfoHash);
+        if (has_torrent(pInfoHash)) {
+            throw DuplicateTorrentException("Torrent was previously added", pInfoHash);
+        }
+
+        prepare_torrent_params(pTorrentParams, pInfoHash, pIsResumeData, pDownload);
+        auto plugin = StreamingPlugin::attach(pTorrentParams, pInfoHash, mLogger);
+        auto memoryBuffer = attach_memory_storage(pTorrentParams, pInfoHash, pMemory);
+        mPendingTorrents.emplace(pInfoHash, PendingTorrent{pSourceType, pSourceKey, pDownload, plugin, memoryBuffer});
+        mSession->async_add_torrent(pTorrentParams);
+    }
+
+    std::string Service::add_magnet(const std::string &pMagnet, bool pDownload, bool pMemory, bool pSaveMagnet) {
+        mLogger->debug("operation=add_magnet, message='Adding magnet', magnet='{}', download={}, memory={}, "
+                       "saveMagnet={}", pMagnet, pDownload, pMemory, pSaveMagnet);
+        check_memory_storage(pDownload, pMemory);
         libtorrent::add_torrent_params torrentParams;
         libtorrent::error_code errorCode;
         libtorrent::parse_magnet_uri(pMagnet, torrentParams, errorCode);
@@ -705,156 +1298,259 @@ namespace torrest { namespace bittorrent {
         }
 
         auto infoHash = get_info_hash(torrentParams.INFO_HASH_PARAM);
-        add_torrent_with_params(torrentParams, infoHash, false, pDownload);
+        add_torrent_with_params(torrentParams, infoHash, false, pDownload, pMemory);
 
-        if (pSaveMagnet) {
-            std::ofstream of(get_magnet_file(infoHash), std::ios::binary);
-            of << Magnet{pMagnet, pDownload};
+        if (pSaveMagnet && !pMemory) {
+            save_magnet(infoHash, pMagnet, pDownload);
         }
 
         return infoHash;
     }
 
-    std::string Service::add_magnet(const std::string &pMagnet, bool pDownload) {
+    std::string Service::add_magnet(const std::string &pMagnet, bool pDownload, bool pMemory) {
         std::lock_guard<std::mutex> lock(mTorrentsMutex);
-        return add_magnet(pMagnet, pDownload, true);
+        return add_magnet(pMagnet, pDownload, pMemory, true);
     }
 
-    std::string Service::add_torrent_data(const char *pData, int pSize, bool pDownload) {
-        mLogger->debug("operation=add_torrent_data, message='Adding torrent data', download={}", pDownload);
-        libtorrent::error_code errorCode;
+    void Service::save_magnet(const std::string &pInfoHash, const std::string &pMagnet, bool pDownload) {
+        mStore->save(tr_magnet, pInfoHash, [magnet = Magnet{pMagnet, pDownload}] {
+            std::ostringstream os;
+            os << magnet;
+            auto data = os.str();
+            return std::vector<char>(data.begin(), data.end());
+        });
+    }
+
+    void Service::wait_pending_capacity(std::unique_lock<std::mutex> &pLock) const {
+        // Limit the number of pending torrents so that no add torrent alert is dropped
+        if (!mPendingCv.wait_for(pLock, std::chrono::seconds(PENDING_WAIT_TIMEOUT),
+                                 [this] { return mPendingTorrents.size() < MAX_PENDING_TORRENTS; })) {
+            mLogger->error("operation=wait_pending_capacity, message='Timed out waiting for pending torrents', "
+                           "pending={}", mPendingTorrents.size());
+            throw LoadTorrentException("Timed out waiting for pending torrents");
+        }
+    }
+
+    void Service::wait_pending_torrent(std::unique_lock<std::mutex> &pLock, const std::string &pInfoHash) const {
+        // Torrents being added asynchronously are only available once the session confirms them
+        if (!mPendingCv.wait_for(pLock, std::chrono::seconds(PENDING_WAIT_TIMEOUT), [this, &pInfoHash] {
+            return mPendingTorrents.find(pInfoHash) == mPendingTorrents.end();
+        })) {
+            mLogger->error("operation=wait_pending_torrent, message='Timed out waiting for torrent', infoHash={}",
+                           pInfoHash);
+            throw InvalidTorrentException("Timed out waiting for torrent to be added");
+        }
+    }
+
+    std::string Service::async_add_magnet(const std::string &pMagnet, bool pDownload, bool pMemory) {
+        mLogger->debug("operation=async_add_magnet, message='Adding magnet', magnet='{}', download={}, memory={}",
+                       pMagnet, pDownload, pMemory);
+        check_memory_storage(pDownload, pMemory);
         libtorrent::add_torrent_params torrentParams;
-        torrentParams.ti = std::make_shared<libtorrent::torrent_info>(pData, pSize, errorCode);
+        libtorrent::error_code errorCode;
+        libtorrent::parse_magnet_uri(pMagnet, torrentParams, errorCode);
         if (errorCode.failed()) {
-            mLogger->error("operation=add_torrent_data, message='Failed adding torrent data: {}'", errorCode.message());
+            mLogger->error("operation=async_add_magnet, message='Failed parsing magnet: {}'", errorCode.message());
             throw LoadTorrentException(errorCode.message());
         }
 
-        auto infoHash = get_info_hash(torrentParams.ti->INFO_HASH_PARAM());
-        std::lock_guard<std::mutex> lock(mTorrentsMutex);
-        add_torrent_with_params(torrentParams, infoHash, false, pDownload);
-        std::ofstream of(get_torrent_file(infoHash), std::ios::binary);
-        of.write(pData, pSize);
+        auto infoHash = get_info_hash(torrentParams.INFO_HASH_PARAM);
+        std::unique_lock<std::mutex> lock(mTorrentsMutex);
+        wait_pending_capacity(lock);
+        if (pMemory) {
+            async_add_torrent_with_params(torrentParams, infoHash, false, pDownload, true, tr_magnet, "");
+        } else {
+            async_add_torrent_with_params(torrentParams, infoHash, false, pDownload, false, tr_magnet, infoHash);
+            save_magnet(infoHash, pMagnet, pDownload);
+        }
 
         return infoHash;
     }
 
-    std::string Service::add_torrent_file(const std::string &pFile, bool pDownload, bool pSaveFile) {
-        mLogger->debug("operation=add_torrent_file, message='Adding torrent file', download={}, saveFile={}",
-                       pDownload, pSaveFile);
-        libtorrent::error_code errorCode;
+    std::string Service::async_add_torrent_file(const std::string &pFile, bool pDownload, bool pMemory) {
+        mLogger->debug("operation=async_add_torrent_file, message='Adding torrent file', download={}, memory={}",
+                       pDownload, pMemory);
+        check_memory_storage(pDownload, pMemory);
+        auto data = utils::read_file(pFile);
         libtorrent::add_torrent_params torrentParams;
-        torrentParams.ti = std::make_shared<libtorrent::torrent_info>(pFile, errorCode);
-        if (errorCode.failed()) {
-            mLogger->error("operation=add_torrent_file, message='Failed adding torrent: {}'", errorCode.message());
-            throw LoadTorrentException(errorCode.message());
-        }
+        torrentParams.ti = load_torrent_info(data);
 
         auto infoHash = get_info_hash(torrentParams.ti->INFO_HASH_PARAM());
-        add_torrent_with_params(torrentParams, infoHash, false, pDownload);
-
-        if (pSaveFile) {
-            auto destPath = get_torrent_file(infoHash);
-            if (!boost::filesystem::equivalent(pFile, destPath)) {
-                boost::filesystem::copy_file(pFile, destPath);
-            }
+        std::unique_lock<std::mutex> lock(mTorrentsMutex);
+        wait_pending_capacity(lock);
+        if (pMemory) {
+            async_add_torrent_with_params(torrentParams, infoHash, false, pDownload, true, tr_torrent, "");
+        } else {
+            async_add_torrent_with_params(torrentParams, infoHash, false, pDownload, false, tr_torrent, infoHash);
+            mStore->save(tr_torrent, infoHash, [data = std::move(data)] { return data; });
         }
 
         return infoHash;
     }
 
-    std::string Service::add_torrent_file(const std::string &pFile, bool pDownload) {
+    std::string Service::add_torrent_data(const char *pData, int pSize, bool pDownload, bool pMemory) {
+        mLogger->debug("operation=add_torrent_data, message='Adding torrent data', download={}, memory={}",
+                       pDownload, pMemory);
+        check_memory_storage(pDownload, pMemory);
+        std::vector<char> data(pData, pData + pSize);
+        libtorrent::add_torrent_params torrentParams;
+        torrentParams.ti = load_torrent_info(data);
+
+        auto infoHash = get_info_hash(torrentParams.ti->INFO_HASH_PARAM());
         std::lock_guard<std::mutex> lock(mTorrentsMutex);
-        return add_torrent_file(pFile, pDownload, true);
+        add_torrent_with_params(torrentParams, infoHash, false, pDownload, pMemory);
+        if (!pMemory) {
+            mStore->save(tr_torrent, infoHash, [data = std::move(data)] { return data; });
+        }
+
+        return infoHash;
     }
 
-    void Service::add_torrent_with_resume_data(const std::string &pFile) {
-        mLogger->debug("operation=add_torrent_with_resume_data");
-        std::ifstream ifs(pFile, std::ios::binary);
-        ifs.unsetf(std::ios::skipws);
-        std::vector<char> resumeData{std::istream_iterator<char>(ifs), std::istream_iterator<char>()};
+    std::string Service::add_torrent_file(const std::string &pFile, bool pDownload, bool pMemory) {
+        mLogger->debug("operation=add_torrent_file, message='Adding torrent file', download={}, memory={}",
+                       pDownload, pMemory);
+        check_memory_storage(pDownload, pMemory);
+        // Read the file only once, as the same buffer is both parsed and persisted
+        auto data = utils::read_file(pFile);
+        libtorrent::add_torrent_params torrentParams;
+        torrentParams.ti = load_torrent_info(data);
+
+        auto infoHash = get_info_hash(torrentParams.ti->INFO_HASH_PARAM());
+        std::lock_guard<std::mutex> lock(mTorrentsMutex);
+        add_torrent_with_params(torrentParams, infoHash, false, pDownload, pMemory);
+        if (!pMemory) {
+            mStore->save(tr_torrent, infoHash, [data = std::move(data)] { return data; });
+        }
+
+        return infoHash;
+    }
 
+    std::shared_ptr<libtorrent::torrent_info> Service::load_torrent_info(const std::vector<char> &pData) const {
         libtorrent::error_code errorCode;
-        auto torrentParams = libtorrent::read_resume_data(resumeData, errorCode);
+        auto torrentInfo = std::make_shared<libtorrent::torrent_info>(pData.data(), int(pData.size()), errorCode);
         if (errorCode.failed()) {
-            mLogger->error("operation=add_torrent_with_resume_data, message='{}'", errorCode.message());
+            mLogger->error("operation=load_torrent_info, message='Failed loading torrent: {}'", errorCode.message());
             throw LoadTorrentException(errorCode.message());
         }
+        return torrentInfo;
+    }
 
-        auto infoHash = get_info_hash(torrentParams.INFO_HASH_PARAM);
-        add_torrent_with_params(torrentParams, infoHash, true, true);
+    void Service::load_read_positions(const TorrentRecord &pRecord) {
+        ReadPositions readPositions;
+        std::istringstream is(std::string(pRecord.data.begin(), pRecord.data.end()));
+        is >> readPositions;
+
+        std::lock_guard<std::mutex> lock(mTorrentsMutex);
+        mReadPositions[pRecord.info_hash] = std::move(readPositions.positions);
+    }
+
+    void Service::restore_read_positions(const std::shared_ptr<Torrent> &pTorrent) {
+        auto it = mReadPositions.find(pTorrent->mInfoHash);
+        if (it != mReadPositions.end()) {
+            pTorrent->set_read_positions(std::move(it->second));
+            mReadPositions.erase(it);
+        }
+    }
+
+    void Service::save_read_positions() const {
+        std::lock_guard<std::mutex> lock(mTorrentsMutex);
+        for (auto &torrent : mTorrents) {
+            ReadPositions readPositions;
+            if (torrent->is_memory_storage() || !torrent->get_dirty_read_positions(readPositions.positions)) {
+                continue;
+            }
+
+            if (readPositions.positions.empty()) {
+                mStore->remove(tr_read_positions, torrent->mInfoHash);
+            } else {
+                mStore->save(tr_read_positions, torrent->mInfoHash, [readPositions = std::move(readPositions)] {
+                    std::ostringstream os;
+                    os << readPositions;
+                    auto data = os.str();
+                    return std::vector<char>(data.begin(), data.end());
+                });
+            }
+        }
     }
 
     void Service::load_torrent_files() {
         mLogger->debug("operation=load_torrent_files, message='Loading torrent files'");
-        std::vector<std::string> fastResumeFiles;
-        std::vector<std::string> torrentFiles;
-        std::vector<std::string> magnetFiles;
+        std::vector<TorrentFileEntry> entries;
+        auto settings = mSettings->load();
 
-        for (auto &p : boost::filesystem::directory_iterator(mSettings->get_torrents_path())) {
-            if (boost::filesystem::is_regular_file(p.path())) {
-                auto ext = p.path().extension();
-                if (ext == EXT_FASTRESUME) {
-                    fastResumeFiles.emplace_back(p.path().string());
-                } else if (ext == EXT_TORRENT) {
-                    torrentFiles.emplace_back(p.path().string());
-                } else if (ext == EXT_MAGNET) {
-                    magnetFiles.emplace_back(p.path().string());
-                }
+        for (auto &record : mStore->load()) {
+            if (record.type == tr_read_positions) {
+                load_read_positions(record);
+            } else {
+                entries.push_back(TorrentFileEntry{std::move(record)});
             }
         }
 
-        for (auto &f : fastResumeFiles) {
-            try {
-                add_torrent_with_resume_data(f);
-            } catch (const BittorrentException &e) {
-                mLogger->error("operation=load_torrent_files, message='Failed adding torrent with resume data'"
-                               ", what='{}', file='{}'", e.what(), f);
-                boost::filesystem::remove(f);
-            }
+        // Fast resume files take precedence over torrent files, which take precedence over magnets
+        std::stable_sort(entries.begin(), entries.end(), [](const TorrentFileEntry &a, const TorrentFileEntry &b) {
+            return a.record.type < b.record.type;
+        });
+
+        // Parse the files in parallel
+        std::atomic<std::size_t> nextEntry(0);
+        std::vector<std::thread> workers;
+        auto numWorkers = std::min<std::size_t>(std::max(std::thread::hardware_concurrency(), 1u), entries.size());
+        mLogger->debug("operation=load_torrent_files, message='Parsing torrent files', count={}, workers={}",
+                       entries.size(), numWorkers);
+
+        for (std::size_t i = 0; i < numWorkers; i++) {
+            workers.emplace_back([&entries, &nextEntry] {
+                for (auto e = nextEntry++; e < entries.size(); e = nextEntry++) {
+                    parse_torrent_file_entry(entries[e]);
+                }
+            });
         }
 
-        for (auto &f : torrentFiles) {
-            try {
-                add_torrent_file(f, false, false);
-            } catch (const LoadTorrentException &e) {
-                mLogger->error("operation=load_torrent_files, message='Failed loading torrent', what='{}', file='{}'",
-                               e.what(), f);
-                boost::filesystem::remove(f);
-            } catch (const DuplicateTorrentException &e) {
-                mLogger->debug("operation=load_torrent_files, message='{}', infoHash={}, file='{}'",
-                               e.what(), e.get_info_hash(), f);
-            } catch (const BittorrentException &e) {
-                mLogger->error("operation=load_torrent_files, message='Failed adding torrent', what='{}', file='{}'",
-                               e.what(), f);
-            }
+        for (auto &worker : workers) {
+            worker.join();
         }
 
-        for (auto &f : magnetFiles) {
-            Magnet m;
+        for (auto &entry : entries) {
+            // Lock each entry separately, so that API calls are not blocked for the whole load
+            std::unique_lock<std::mutex> lock(mTorrentsMutex);
+            if (!entry.error.empty()) {
+                mLogger->error("operation=load_torrent_files, message='Failed parsing torrent file', what='{}', "
+                               "infoHash={}, type={}", entry.error, entry.record.info_hash, int(entry.record.type));
+                mStore->remove(entry.record.type, entry.record.info_hash);
+                continue;
+            }
+
+            if (settings->lazy_activation && entry.record.type == tr_fast_resume
+                && is_dormant_candidate(entry.params) && !has_torrent(entry.info_hash)) {
+                add_dormant_torrent(entry.params, entry.info_hash);
+                continue;
+            }
+
             try {
-                std::ifstream ifs(f, std::ios::binary);
-                ifs >> m;
-            } catch (const std::exception &e) {
-                mLogger->error("operation=load_torrent_files, message='Failed parsing magnet file', what='{}'",
+                wait_pending_capacity(lock);
+            } catch (const LoadTorrentException &e) {
+                mLogger->error("operation=load_torrent_files, message='Aborting torrents loading', what='{}'",
                                e.what());
-                continue;
+                break;
             }
 
             try {
-                add_magnet(m.magnet, m.download, false);
+                async_add_torrent_with_params(entry.params, entry.info_hash, entry.record.type == tr_fast_resume,
+                                              entry.download, false, entry.record.type, entry.record.info_hash);
             } catch (const DuplicateTorrentException &e) {
-                mLogger->debug("operation=load_torrent_files, message='Deleting duplicate magnet', infoHash={}",
-                               e.get_info_hash());
-                delete_magnet_file(e.get_info_hash());
-            } catch (const BittorrentException &e) {
-                mLogger->error("operation=load_torrent_files, message='Failed adding magnet', what='{}', file='{}'",
-                               e.what(), f);
-                boost::filesystem::remove(f);
+                mLogger->debug("operation=load_torrent_files, message='{}', infoHash={}, type={}",
+                               e.what(), e.get_info_hash(), int(entry.record.type));
+                if (entry.record.type == tr_magnet) {
+                    mStore->remove(tr_magnet, entry.record.info_hash);
+                }
+            } catch (const TorrentRemovalException &e) {
+                mLogger->warn("operation=load_torrent_files, message='{}', infoHash={}, type={}",
+                              e.what(), e.get_info_hash(), int(entry.record.type));
             }
         }
 
-        for (auto &p : boost::filesystem::directory_iterator(mSettings->get_download_path())) {
+        std::lock_guard<std::mutex> lock(mTorrentsMutex);
+        for (auto &p : boost::filesystem::directory_iterator(settings->download_path)) {
             if (p.path().extension() == EXT_PARTS && boost::filesystem::is_regular_file(p.path())) {
                 auto infoHash = utils::ltrim_copy(p.path().stem().string(), ".");
                 if (!has_torrent(infoHash)) {
@@ -866,6 +1562,113 @@ namespace torrest { namespace bittorrent {
         }
     }
 
+    bool Service::is_dormant_candidate(const libtorrent::add_torrent_params &pTorrentParams) const {
+        if (pTorrentParams.ti == nullptr || !pTorrentParams.ti->is_valid()) {
+            // Dormant torrents are described from their metadata
+            return false;
+        }
+
+        auto flags = pTorrentParams.flags;
+        auto isPaused = (flags & libtorrent::torrent_flags::paused) && !(flags & libtorrent::torrent_flags::auto_managed);
+        auto isSeed = (flags & libtorrent::torrent_flags::seed_mode)
+                      || (pTorrentParams.have_pieces.size() == pTorrentParams.ti->num_pieces()
+                          && pTorrentParams.have_pieces.all_set());
+
+        return isPaused || isSeed;
+    }
+
+    void Service::add_dormant_torrent(const libtorrent::add_torrent_params &pTorrentParams,
+                                      const std::string &pInfoHash) {
+        mLogger->debug("operation=add_dormant_torrent, message='Adding dormant torrent', infoHash={}", pInfoHash);
+        auto flags = pTorrentParams.flags;
+        auto isPaused = (flags & libtorrent::torrent_flags::paused) && !(flags & libtorrent::torrent_flags::auto_managed);
+        auto totalSize = pTorrentParams.ti->total_size();
+        auto totalDone = (flags & libtorrent::torrent_flags::seed_mode)
+                         ? totalSize
+                         : std::min(totalSize, std::int64_t(pTorrentParams.have_pieces.count())
+                                               * pTorrentParams.ti->piece_length());
+
+        mDormantTorrents.emplace(pInfoHash, DormantTorrent{
+                TorrentInfo{
+                        .info_hash=pInfoHash,
+                        .name=pTorrentParams.ti->name(),
+                        .size=totalSize,
+                },
+                TorrentStatus{
+                        .total=totalSize,
+                        .total_done=totalDone,
+                        .total_wanted=totalSize,
+                        .total_wanted_done=totalDone,
+                        .progress=totalSize > 0
+                                  ? 100 * static_cast<double>(totalDone) / static_cast<double>(totalSize) : 100,
+                        .download_rate=0,
+                        .upload_rate=0,
+                        .paused=isPaused,
+                        .has_metadata=true,
+                        .state=isPaused ? paused : queued,
+                        .seeders=0,
+                        .seeders_total=0,
+                        .peers=0,
+                        .peers_total=0,
+                        .seeding_time=pTorrentParams.seeding_time,
+                        .finished_time=pTorrentParams.finished_time,
+                        .active_time=pTorrentParams.active_time,
+                        .all_time_download=pTorrentParams.total_downloaded,
+                        .all_time_upload=pTorrentParams.total_uploaded,
+                        .deadline_hits=0,
+                        .deadline_misses=0,
+                        .deadline_hit_ratio=100,
+                },
+        });
+    }
+
+    libtorrent::add_torrent_params Service::take_dormant_torrent(const std::string &pInfoHash) {
+        mLogger->debug("operation=take_dormant_torrent, message='Activating dormant torrent', infoHash={}", pInfoHash);
+        mDormantTorrents.erase(pInfoHash);
+
+        libtorrent::error_code errorCode;
+        auto torrentParams = libtorrent::read_resume_data(mStore->get(tr_fast_resume, pInfoHash), errorCode);
+        if (errorCode.failed()) {
+            mLogger->error("operation=take_dormant_torrent, message='{}', infoHash={}",
+                           errorCode.message(), pInfoHash);
+            throw LoadTorrentException(errorCode.message());
+        }
+
+        return torrentParams;
+    }
+
+    std::shared_ptr<Torrent> Service::activate_torrent(const std::string &pInfoHash) {
+        auto torrentParams = take_dormant_torrent(pInfoHash);
+        add_torrent_with_params(torrentParams, pInfoHash, true, true, false);
+        return mTorrents.back();
+    }
+
+    void Service::activate_dormant_seeds(int pActiveSeeds, int pActiveSeedsLimit) {
+        std::vector<std::string> infoHashes;
+        for (auto &dormant : mDormantTorrents) {
+            if ((pActiveSeedsLimit >= 0 && pActiveSeeds >= pActiveSeedsLimit)
+                || mPendingTorrents.size() + infoHashes.size() >= MAX_PENDING_TORRENTS) {
+                break;
+            }
+            if (!dormant.second.status.paused) {
+                infoHashes.push_back(dormant.first);
+                pActiveSeeds++;
+            }
+        }
+
+        for (auto &infoHash : infoHashes) {
+            try {
+                // Seeds are activated from the event loop, so they are added asynchronously
+                auto torrentParams = take_dormant_torrent(infoHash);
+                async_add_torrent_with_params(torrentParams, infoHash, true, true, false, tr_fast_resume, "");
+                mActivatingSeeds.insert(infoHash);
+            } catch (const std::exception &e) {
+                mLogger->error("operation=activate_dormant_seeds, message='Failed activating torrent', what='{}', "
+                               "infoHash={}", e.what(), infoHash);
+            }
+        }
+    }
+
     std::vector<std::shared_ptr<Torrent>>::const_iterator Service::find_torrent(const std::string &pInfoHash) const {
         mLogger->trace("operation=find_torrent, infoHash={}", pInfoHash);
         return std::find_if(
@@ -886,11 +1689,49 @@ namespace torrest { namespace bittorrent {
     }
 
     bool Service::has_torrent(const std::string &pInfoHash) const {
-        return find_torrent(pInfoHash) != mTorrents.end();
+        auto infoHash = boost::algorithm::to_lower_copy(pInfoHash);
+        auto removal = mRemovals.find(infoHash);
+        return find_torrent(pInfoHash) != mTorrents.end()
+               || mPendingTorrents.find(infoHash) != mPendingTorrents.end()
+               || mDormantTorrents.find(infoHash) != mDormantTorrents.end()
+               || (removal != mRemovals.end() && removal->second.delete_files && !removal->second.failed);
     }
 
-    std::shared_ptr<Torrent> Service::get_torrent(const std::string &pInfoHash) const {
+    void Service::check_not_removing(const std::string &pInfoHash) const {
+        // A torrent whose files are still being deleted can't be added again, otherwise its new files could be deleted
+        auto removal = mRemovals.find(boost::algorithm::to_lower_copy(pInfoHash));
+        if (removal != mRemovals.end() && removal->second.delete_files && !removal->second.failed) {
+            throw TorrentRemovalException("Torrent is being removed", pInfoHash);
+        }
+    }
+
+    std::shared_ptr<Torrent> Service::get_torrent(const std::string &pInfoHash) {
         mLogger->trace("operation=get_torrent, infoHash={}", pInfoHash);
+        std::unique_lock<std::mutex> lock(mTorrentsMutex);
+        auto infoHash = boost::algorithm::to_lower_copy(pInfoHash);
+        wait_pending_torrent(lock, infoHash);
+        if (mDormantTorrents.find(infoHash) != mDormantTorrents.end()) {
+            return activate_torrent(infoHash);
+        }
+        return *must_find_torrent(pInfoHash);
+    }
+
+    std::shared_ptr<Torrent> Service::try_get_torrent(const std::string &pInfoHash) {
+        mLogger->trace("operation=try_get_torrent, infoHash={}", pInfoHash);
+        std::lock_guard<std::mutex> lock(mTorrentsMutex);
+        auto infoHash = boost::algorithm::to_lower_copy(pInfoHash);
+        // Torrents still being added are not waited for
+        if (mPendingTorrents.find(infoHash) != mPendingTorrents.end()) {
+            return nullptr;
+        }
+        if (mDormantTorrents.find(infoHash) != mDormantTorrents.end()) {
+            return activate_torrent(infoHash);
+        }
+        return *must_find_torrent(pInfoHash);
+    }
+
+    std::shared_ptr<Torrent> Service::get_active_torrent(const std::string &pInfoHash) const {
+        mLogger->trace("operation=get_active_torrent, infoHash={}", pInfoHash);
         std::lock_guard<std::mutex> lock(mTorrentsMutex);
         return *must_find_torrent(pInfoHash);
     }
@@ -901,32 +1742,98 @@ namespace torrest { namespace bittorrent {
         return mTorrents;
     }
 
+    std::vector<DormantTorrent> Service::get_dormant_torrents() const {
+        mLogger->trace("operation=get_dormant_torrents");
+        std::lock_guard<std::mutex> lock(mTorrentsMutex);
+        std::vector<DormantTorrent> torrents;
+        torrents.reserve(mDormantTorrents.size());
+        for (auto &dormant : mDormantTorrents) {
+            torrents.push_back(dormant.second);
+        }
+        return torrents;
+    }
+
     void Service::remove_torrent(const std::string &pInfoHash, bool pRemoveFiles) {
         mLogger->debug("operation=remove_torrent, infoHash={}, removeFiles={}", pInfoHash, pRemoveFiles);
-        std::lock_guard<std::mutex> lock(mTorrentsMutex);
+        std::unique_lock<std::mutex> lock(mTorrentsMutex);
+        auto infoHash = boost::algorithm::to_lower_copy(pInfoHash);
+        wait_pending_torrent(lock, infoHash);
+
+        auto dormantIt = mDormantTorrents.find(infoHash);
+        if (dormantIt != mDormantTorrents.end()) {
+            if (!pRemoveFiles) {
+                delete_parts_file(infoHash);
+                mStore->remove(tr_fast_resume, infoHash);
+                mStore->remove(tr_torrent, infoHash);
+                mStore->remove(tr_magnet, infoHash);
+                mStore->remove(tr_read_positions, infoHash);
+                mReadPositions.erase(infoHash);
+                mDormantTorrents.erase(dormantIt);
+                return;
+            }
+            // The torrent must be in the session so that its files can be deleted
+            activate_torrent(infoHash);
+        }
+
         auto it = must_find_torrent(pInfoHash);
+        auto torrent = *it;
+
+        // Unlink the torrent right away, the session removes it and deletes its files in the background
+        torrent->mClosed = true;
+        mTorrents.erase(it);
+        mResumeDataRequests.erase(torrent->mInfoHash);
+        mRemovals[torrent->mInfoHash] = RemovalStatus{
+                .info_hash=torrent->mInfoHash,
+                .name=torrent->get_info().name,
+                .delete_files=pRemoveFiles,
+                .failed=false,
+                .error="",
+                .state=rs_removing,
+                .size=pRemoveFiles ? torrent->get_status().total_done : 0,
+                .elapsed_time=0,
+                .started_at=std::chrono::steady_clock::now(),
+        };
 
-        delete_parts_file(pInfoHash);
-        delete_fast_resume_file(pInfoHash);
-        delete_torrent_file(pInfoHash);
-        delete_magnet_file(pInfoHash);
+        delete_parts_file(torrent->mInfoHash);
+        mStore->remove(tr_fast_resume, torrent->mInfoHash);
+        mStore->remove(tr_torrent, torrent->mInfoHash);
+        mStore->remove(tr_magnet, torrent->mInfoHash);
+        mStore->remove(tr_read_positions, torrent->mInfoHash);
+        mReadPositions.erase(torrent->mInfoHash);
 
-        (*it)->mClosed = true;
         mSession->remove_torrent(
-                (*it)->mHandle,
+                torrent->mHandle,
                 pRemoveFiles ? libtorrent::session_handle::delete_files : libtorrent::remove_flags_t(0));
+    }
 
-        mTorrents.erase(it);
+    std::vector<RemovalStatus> Service::get_removals() const {
+        mLogger->trace("operation=get_removals");
+        std::lock_guard<std::mutex> lock(mTorrentsMutex);
+        std::vector<RemovalStatus> removals;
+        removals.reserve(mRemovals.size());
+        auto now = std::chrono::steady_clock::now();
+        for (auto &removal : mRemovals) {
+            removals.push_back(removal.second);
+            removals.back().elapsed_time = std::chrono::duration_cast<std::chrono::seconds>(
+                    now - removal.second.started_at).count();
+        }
+        return removals;
     }
 
     ServiceStatus Service::get_status() const {
         mLogger->trace("operation=get_status");
+        std::size_t numTorrents;
+        {
+            std::lock_guard<std::mutex> tLock(mTorrentsMutex);
+            numTorrents = mTorrents.size() + mDormantTorrents.size();
+        }
+
         std::lock_guard<std::mutex> lock(mServiceMutex);
         return ServiceStatus{
                 .progress=mProgress,
                 .download_rate=mDownloadRate,
                 .upload_rate=mUploadRate,
-                .num_torrents=static_cast<int>(mTorrents.size()),
+                .num_torrents=static_cast<int>(numTorrents),
                 .paused=mSession->is_paused(),
         };
     }
@@ -942,45 +1849,35 @@ namespace torrest { namespace bittorrent {
     }
 
     inline std::string Service::get_parts_file(const std::string &pInfoHash) const {
-        return utils::join_path(mSettings->get_download_path(), "." + pInfoHash + EXT_PARTS).string();
+        return utils::join_path(mSettings->load()->download_path, "." + pInfoHash + EXT_PARTS).string();
     }
 
-    inline std::string Service::get_fast_resume_file(const std::string &pInfoHash) const {
-        return utils::join_path(mSettings->get_torrents_path(), pInfoHash + EXT_FASTRESUME).string();
+    std::string Service::get_uploads_path() const {
+        return utils::join_path(mSettings->load()->torrents_path, UPLOADS_DIR).string();
     }
 
-    inline std::string Service::get_torrent_file(const std::string &pInfoHash) const {
-        return utils::join_path(mSettings->get_torrents_path(), pInfoHash + EXT_TORRENT).string();
+    void Service::clean_uploads() const {
+        // Uploads are removed once handled, so any file left behind is from a previous crash
+        boost::system::error_code errorCode;
+        for (auto &p : boost::filesystem::directory_iterator(get_uploads_path(), errorCode)) {
+            if (boost::filesystem::is_regular_file(p.path())) {
+                mLogger->debug("operation=clean_uploads, message='Removing stale upload', path='{}'",
+                               p.path().string());
+                boost::filesystem::remove(p.path(), errorCode);
+            }
+        }
     }
 
-    inline std::string Service::get_magnet_file(const std::string &pInfoHash) const {
-        return utils::join_path(mSettings->get_torrents_path(), pInfoHash + EXT_MAGNET).string();
+    inline std::string Service::get_session_state_file() const {
+        return utils::join_path(mSettings->load()->torrents_path, SESSION_STATE_FILE).string();
     }
 
     inline void Service::delete_parts_file(const std::string &pInfoHash) const {
-        boost::filesystem::remove(get_parts_file(pInfoHash));
-    }
-
-    inline void Service::delete_fast_resume_file(const std::string &pInfoHash) const {
-        boost::filesystem::remove(get_fast_resume_file(pInfoHash));
-    }
-
-    inline void Service::delete_torrent_file(const std::string &pInfoHash) const {
-        boost::filesystem::remove(get_torrent_file(pInfoHash));
-    }
-
-    inline void Service::delete_magnet_file(const std::string &pInfoHash) const {
-        boost::filesystem::remove(get_magnet_file(pInfoHash));
-    }
-
-    bool Service::wait_for_abort(const int &pSeconds) const {
-        return wait_for_abort(std::chrono::seconds(pSeconds));
+        remove_file(get_parts_file(pInfoHash));
     }
 
-    bool Service::wait_for_abort(const std::chrono::seconds &pSeconds) const {
-        auto until = std::chrono::steady_clock::now() + pSeconds;
-        std::unique_lock<std::mutex> lock(mCvMutex);
-        return mCv.wait_until(lock, until, [this] { return !mIsRunning.load(); });
+    void Service::remove_file(const std::string &pPath) const {
+        mPersistenceQueue->enqueue(pPath, [pPath] { boost::filesystem::remove(pPath); });
     }
 
 }}
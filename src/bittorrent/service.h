@@ -2,20 +2,29 @@
 #define TORREST_SERVICE_H
 
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <regex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "libtorrent/session.hpp"
 #include "libtorrent/settings_pack.hpp"
 #include "spdlog/spdlog.h"
 
+#include "alert_dispatcher.h"
+#include "event_loop.h"
 #include "file.h"
+#include "persistence_queue.h"
 #include "settings.h"
 #include "settings/settings.h"
 #include "torrent.h"
+#include "torrent_store.h"
 
 namespace torrest { namespace bittorrent {
 
@@ -27,6 +36,31 @@ namespace torrest { namespace bittorrent {
         bool paused;
     };
 
+    struct DormantTorrent {
+        TorrentInfo info;
+        TorrentStatus status;
+    };
+
+    struct RemovalStatus {
+        std::string info_hash;
+        std::string name;
+        bool delete_files;
+        bool failed;
+        std::string error;
+        RemovalState state;
+        std::int64_t size;
+        std::int64_t elapsed_time;
+        std::chrono::steady_clock::time_point started_at;
+    };
+
+    struct PendingTorrent {
+        TorrentRecordType type;
+        std::string key;
+        bool download;
+        std::shared_ptr<StreamingPlugin> plugin;
+        std::shared_ptr<MemoryBuffer> memory_buffer;
+    };
+
     class Service {
     public:
         explicit Service(const settings::Settings &pSettings);
@@ -35,17 +69,27 @@ namespace torrest { namespace bittorrent {
 
         void reconfigure(const settings::Settings &pSettings, bool pReset);
 
-        std::shared_ptr<Torrent> get_torrent(const std::string &pInfoHash) const;
+        std::shared_ptr<Torrent> get_torrent(const std::string &pInfoHash);
+
+        std::shared_ptr<Torrent> try_get_torrent(const std::string &pInfoHash);
 
         std::vector<std::shared_ptr<Torrent>> get_torrents() const;
 
+        std::vector<DormantTorrent> get_dormant_torrents() const;
+
         void remove_torrent(const std::string &pInfoHash, bool pRemoveFiles);
 
-        std::string add_magnet(const std::string &pMagnet, bool pDownload);
+        std::vector<RemovalStatus> get_removals() const;
+
+        std::string add_magnet(const std::string &pMagnet, bool pDownload, bool pMemory);
+
+        std::string add_torrent_data(const char *pData, int pSize, bool pDownload, bool pMemory);
 
-        std::string add_torrent_data(const char *pData, int pSize, bool pDownload);
+        std::string add_torrent_file(const std::string &pFile, bool pDownload, bool pMemory);
 
-        std::string add_torrent_file(const std::string &pFile, bool pDownload);
+        std::string async_add_magnet(const std::string &pMagnet, bool pDownload, bool pMemory);
+
+        std::string async_add_torrent_file(const std::string &pFile, bool pDownload, bool pMemory);
 
         ServiceStatus get_status() const;
 
@@ -53,73 +97,143 @@ namespace torrest { namespace bittorrent {
 
         void resume();
 
+        std::string get_uploads_path() const;
+
     private:
-        void check_save_resume_data_handler() const;
+        std::shared_ptr<libtorrent::session> create_session(const settings::Settings &pSettings);
+
+        void save_session_state() const;
 
-        void consume_alerts_handler() const;
+        void register_alert_handlers();
 
-        void progress_handler();
+        void start_event_loop();
+
+        void check_save_resume_data();
+
+        void expire_resume_data_requests(const std::chrono::steady_clock::time_point &pRequestedBefore);
+
+        void consume_alerts() const;
 
         void update_progress();
 
+        void check_deadlines() const;
+
+        void log_alert(const libtorrent::alert *pAlert) const;
+
 #if !TORREST_LEGACY_READ_PIECE
 
-        void piece_cleanup_handler() const;
+        void cleanup_pieces() const;
 
         void handle_read_piece_alert(const libtorrent::read_piece_alert *pAlert) const;
 
 #endif //TORREST_LEGACY_READ_PIECE
 
-        void handle_save_resume_data(const libtorrent::save_resume_data_alert *pAlert) const;
+        void handle_save_resume_data(const libtorrent::save_resume_data_alert *pAlert);
+
+        void handle_save_resume_data_failed(const libtorrent::save_resume_data_failed_alert *pAlert);
+
+        void handle_add_torrent(const libtorrent::add_torrent_alert *pAlert);
 
         void handle_metadata_received(const libtorrent::metadata_received_alert *pAlert) const;
 
         void handle_state_changed(const libtorrent::state_changed_alert *pAlert) const;
 
+        void handle_piece_finished(const libtorrent::piece_finished_alert *pAlert) const;
+
+        void handle_block_finished(const libtorrent::block_finished_alert *pAlert) const;
+
+        void handle_hash_failed(const libtorrent::hash_failed_alert *pAlert) const;
+
+        void handle_alerts_dropped(const libtorrent::alerts_dropped_alert *pAlert);
+
+        void handle_torrent_removed(const libtorrent::torrent_removed_alert *pAlert);
+
+        void handle_torrent_deleted(const libtorrent::torrent_deleted_alert *pAlert);
+
+        void handle_torrent_delete_failed(const libtorrent::torrent_delete_failed_alert *pAlert);
+
         libtorrent::settings_pack configure(const settings::Settings &pSettings);
 
+        static libtorrent::alert_category_t get_alert_mask(bool pPieceProgress, bool pBlockProgress);
+
+        void set_progress_alerts(bool pPieceProgress, bool pBlockProgress);
+
         void set_buffering_rate_limits(bool pEnable);
 
         void remove_torrents();
 
+        void prepare_torrent_params(libtorrent::add_torrent_params &pTorrentParams,
+                                    const std::string &pInfoHash,
+                                    bool pIsResumeData,
+                                    bool pDownload) const;
+
+        void check_memory_storage(bool pDownload, bool pMemory) const;
+
+        std::shared_ptr<MemoryBuffer> attach_memory_storage(libtorrent::add_torrent_params &pTorrentParams,
+                                                            const std::string &pInfoHash,
+                                                            bool pMemory) const;
+
         void add_torrent_with_params(libtorrent::add_torrent_params &pTorrentParams,
                                      const std::string &pInfoHash,
                                      bool pIsResumeData,
-                                     bool pDownload);
+                                     bool pDownload,
+                                     bool pMemory);
+
+        void async_add_torrent_with_params(libtorrent::add_torrent_params &pTorrentParams,
+                                           const std::string &pInfoHash,
+                                           bool pIsResumeData,
+                                           bool pDownload,
+                                           bool pMemory,
+                                           TorrentRecordType pSourceType,
+                                           const std::string &pSourceKey);
+
+        std::shared_ptr<libtorrent::torrent_info> load_torrent_info(const std::vector<char> &pData) const;
+
+        std::string add_magnet(const std::string &pMagnet, bool pDownload, bool pMemory, bool pSaveMagnet);
+
+        void save_magnet(const std::string &pInfoHash, const std::string &pMagnet, bool pDownload);
+
+        void wait_pending_capacity(std::unique_lock<std::mutex> &pLock) const;
+
+        void wait_pending_torrent(std::unique_lock<std::mutex> &pLock, const std::string &pInfoHash) const;
 
-        std::string add_torrent_file(const std::string &pFile, bool pDownload, bool pSaveFile);
+        void load_read_positions(const TorrentRecord &pRecord);
 
-        std::string add_magnet(const std::string &pMagnet, bool pDownload, bool pSaveMagnet);
+        void restore_read_positions(const std::shared_ptr<Torrent> &pTorrent);
 
-        void add_torrent_with_resume_data(const std::string &pFile);
+        void save_read_positions() const;
 
         void load_torrent_files();
 
-        std::vector<std::shared_ptr<Torrent>>::const_iterator find_torrent(const std::string &pInfoHash) const;
+        bool is_dormant_candidate(const libtorrent::add_torrent_params &pTorrentParams) const;
 
-        std::vector<std::shared_ptr<Torrent>>::const_iterator must_find_torrent(const std::string &pInfoHash) const;
+        void add_dormant_torrent(const libtorrent::add_torrent_params &pTorrentParams, const std::string &pInfoHash);
 
-        bool has_torrent(const std::string &pInfoHash) const;
+        libtorrent::add_torrent_params take_dormant_torrent(const std::string &pInfoHash);
 
-        std::string get_parts_file(const std::string &pInfoHash) const;
+        std::shared_ptr<Torrent> activate_torrent(const std::string &pInfoHash);
 
-        std::string get_fast_resume_file(const std::string &pInfoHash) const;
+        void activate_dormant_seeds(int pActiveSeeds, int pActiveSeedsLimit);
 
-        std::string get_torrent_file(const std::string &pInfoHash) const;
+        std::shared_ptr<Torrent> get_active_torrent(const std::string &pInfoHash) const;
 
-        std::string get_magnet_file(const std::string &pInfoHash) const;
+        std::vector<std::shared_ptr<Torrent>>::const_iterator find_torrent(const std::string &pInfoHash) const;
 
-        void delete_parts_file(const std::string &pInfoHash) const;
+        std::vector<std::shared_ptr<Torrent>>::const_iterator must_find_torrent(const std::string &pInfoHash) const;
+
+        bool has_torrent(const std::string &pInfoHash) const;
 
-        void delete_fast_resume_file(const std::string &pInfoHash) const;
+        void check_not_removing(const std::string &pInfoHash) const;
 
-        void delete_torrent_file(const std::string &pInfoHash) const;
+        std::string get_parts_file(const std::string &pInfoHash) const;
+
+        std::string get_session_state_file() const;
 
-        void delete_magnet_file(const std::string &pInfoHash) const;
+        void clean_uploads() const;
 
-        bool wait_for_abort(const int &pSeconds) const;
+        void delete_parts_file(const std::string &pInfoHash) const;
 
-        bool wait_for_abort(const std::chrono::seconds &pSeconds) const;
+        void remove_file(const std::string &pPath) const;
 
         const std::regex mPortRegex = std::regex(":(\\d+)$");
         const std::regex mWhiteSpaceRegex = std::regex("\\s+");
@@ -127,17 +241,29 @@ namespace torrest { namespace bittorrent {
         std::shared_ptr<spdlog::logger> mAlertsLogger;
         std::shared_ptr<libtorrent::session> mSession;
         std::vector<std::shared_ptr<Torrent>> mTorrents;
+        std::thread mLoaderThread;
         std::shared_ptr<ServiceSettings> mSettings;
+        AlertDispatcher mAlertDispatcher;
+        std::shared_ptr<PersistenceQueue> mPersistenceQueue;
+        std::shared_ptr<TorrentStore> mStore;
+        std::shared_ptr<EventLoop> mEventLoop;
         mutable std::mutex mTorrentsMutex;
         mutable std::mutex mServiceMutex;
-        mutable std::mutex mCvMutex;
-        mutable std::condition_variable mCv;
-        std::vector<std::thread> mThreads;
-        std::atomic<bool> mIsRunning;
+        std::mutex mResetMutex;
+        std::unordered_map<std::string, PendingTorrent> mPendingTorrents;
+        std::map<std::string, DormantTorrent> mDormantTorrents;
+        std::map<std::string, RemovalStatus> mRemovals;
+        std::unordered_map<std::string, std::map<int, std::int64_t>> mReadPositions;
+        mutable std::condition_variable mPendingCv;
+        std::unordered_map<std::string, std::chrono::steady_clock::time_point> mResumeDataRequests;
+        std::unordered_set<std::string> mActivatingSeeds;
+        std::size_t mResumeDataCursor;
         std::int64_t mDownloadRate;
         std::int64_t mUploadRate;
         double mProgress;
         bool mRateLimited;
+        std::atomic<bool> mHasFilesBuffering{};
+        std::atomic<bool> mIsStreaming{};
     };
 
 }}
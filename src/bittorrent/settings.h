@@ -1,48 +1,20 @@
 #ifndef TORREST_SERVICE_SETTINGS_H
 #define TORREST_SERVICE_SETTINGS_H
 
-#include <mutex>
+#include <atomic>
+#include <memory>
 
 #include "settings/settings.h"
 
-#define SETTING(mtx, type, name)                    \
-    private:                                        \
-        type name;                                  \
-    public:                                         \
-        type get_##name() const {                   \
-            std::lock_guard<std::mutex> l(mtx);     \
-            return name;                            \
-        }                                           \
-        void set_##name(const type &pValue) {       \
-            std::lock_guard<std::mutex> l(mtx);     \
-            name = pValue;                          \
-        }
-
-
 namespace torrest { namespace bittorrent {
 
-    struct ServiceSettings {
-
-    SETTING(mMutex, bool, limit_after_buffering)
-    SETTING(mMutex, int, max_download_rate)
-    SETTING(mMutex, int, max_upload_rate)
-    SETTING(mMutex, std::string, download_path)
-    SETTING(mMutex, std::string, torrents_path)
-    SETTING(mMutex, bool, check_available_space)
-    SETTING(mMutex, int, session_save)
-    SETTING(mMutex, int, seed_time_limit)
-    SETTING(mMutex, int, seed_time_ratio_limit)
-    SETTING(mMutex, int, share_ratio_limit)
-#if !TORREST_LEGACY_READ_PIECE
-    SETTING(mMutex, int, piece_expiration)
-#endif
-    SETTING(mMutex, int, piece_wait_timeout)
-
-    public:
-        explicit ServiceSettings(const settings::Settings &pSettings)
+    struct ServiceSettingsSnapshot {
+        explicit ServiceSettingsSnapshot(const settings::Settings &pSettings)
             : limit_after_buffering(pSettings.limit_after_buffering),
               max_download_rate(pSettings.max_download_rate),
               max_upload_rate(pSettings.max_upload_rate),
+              max_background_rate(pSettings.max_background_rate),
+              max_seeding_rate(pSettings.max_seeding_rate),
               download_path(pSettings.download_path),
               torrents_path(pSettings.torrents_path),
               check_available_space(pSettings.check_available_space),
@@ -50,31 +22,60 @@ namespace torrest { namespace bittorrent {
               seed_time_limit(pSettings.seed_time_limit),
               seed_time_ratio_limit(pSettings.seed_time_ratio_limit),
               share_ratio_limit(pSettings.share_ratio_limit),
+              active_seeds_limit(pSettings.active_seeds_limit),
+              lazy_activation(pSettings.lazy_activation),
+              sequential_window(pSettings.sequential_window),
+              buffer_size(pSettings.buffer_size),
+              prefetch_next_file(pSettings.prefetch_next_file),
+              memory_storage_size(pSettings.memory_storage_size),
 #if !TORREST_LEGACY_READ_PIECE
               piece_expiration(pSettings.piece_expiration),
 #endif
               piece_wait_timeout(pSettings.piece_wait_timeout) {}
 
-        void update(const settings::Settings &pSettings) {
-            std::lock_guard<std::mutex> l(mMutex);
-            limit_after_buffering = pSettings.limit_after_buffering;
-            max_download_rate = pSettings.max_download_rate;
-            max_upload_rate = pSettings.max_upload_rate;
-            download_path = pSettings.download_path;
-            torrents_path = pSettings.torrents_path;
-            check_available_space = pSettings.check_available_space;
-            session_save = pSettings.session_save;
-            seed_time_limit = pSettings.seed_time_limit;
-            seed_time_ratio_limit = pSettings.seed_time_ratio_limit;
-            share_ratio_limit = pSettings.share_ratio_limit;
+        const bool limit_after_buffering;
+        const int max_download_rate;
+        const int max_upload_rate;
+        const int max_background_rate;
+        const int max_seeding_rate;
+        const std::string download_path;
+        const std::string torrents_path;
+        const bool check_available_space;
+        const int session_save;
+        const int seed_time_limit;
+        const int seed_time_ratio_limit;
+        const int share_ratio_limit;
+        const int active_seeds_limit;
+        const bool lazy_activation;
+        const std::int64_t sequential_window;
+        const std::int64_t buffer_size;
+        const int prefetch_next_file;
+        const std::int64_t memory_storage_size;
 #if !TORREST_LEGACY_READ_PIECE
-            piece_expiration = pSettings.piece_expiration;
+        const int piece_expiration;
 #endif
-            piece_wait_timeout = pSettings.piece_wait_timeout;
+        const int piece_wait_timeout;
+    };
+
+    /**
+     * Publishes immutable settings snapshots. Readers take one snapshot per operation
+     * without locking, while updates atomically swap in a new snapshot.
+     */
+    class ServiceSettings {
+    public:
+        explicit ServiceSettings(const settings::Settings &pSettings)
+            : mSnapshot(std::make_shared<const ServiceSettingsSnapshot>(pSettings)) {}
+
+        std::shared_ptr<const ServiceSettingsSnapshot> load() const {
+            return std::atomic_load(&mSnapshot);
+        }
+
+        void update(const settings::Settings &pSettings) {
+            std::atomic_store(&mSnapshot, std::make_shared<const ServiceSettingsSnapshot>(pSettings));
         }
 
     private:
-        mutable std::mutex mMutex;
+        std::shared_ptr<const ServiceSettingsSnapshot> mSnapshot;
     };
 
 }}
@@ -0,0 +1,204 @@
+#include "streaming_plugin.h"
+
+#include <algorithm>
+
+#include "libtorrent/error_code.hpp"
+#include "libtorrent/operations.hpp"
+
+#define LATENCY_SMOOTHING 0.2
+#define THROUGHPUT_SMOOTHING 0.5
+#define SLOW_PEER_FACTOR 3
+#define MIN_SLOW_REQUEST_AGE 1000
+#define MIN_CONNECTED_PEERS 5
+#define MAX_EVICTIONS_PER_TICK 2
+#define MAX_LATE_PIECES 256
+
+namespace {
+
+    std::int64_t get_request_key(const libtorrent::peer_request &pRequest) {
+        return (static_cast<std::int64_t>(static_cast<int>(pRequest.piece)) << 32) | pRequest.start;
+    }
+
+    int get_request_piece(std::int64_t pKey) {
+        return static_cast<int>(pKey >> 32);
+    }
+
+}
+
+namespace torrest { namespace bittorrent {
+
+    StreamingPeerPlugin::StreamingPeerPlugin(libtorrent::peer_connection_handle pHandle)
+            : mHandle(std::move(pHandle)),
+              mReceivedBytes(0),
+              mLatency(-1),
+              mThroughput(0) {}
+
+    void StreamingPeerPlugin::sent_request(const libtorrent::peer_request &pRequest) {
+        mRequests.emplace(get_request_key(pRequest), std::chrono::steady_clock::now());
+    }
+
+    bool StreamingPeerPlugin::on_piece(const libtorrent::peer_request &pPiece, libtorrent::span<char const> pBuf) {
+        auto it = mRequests.find(get_request_key(pPiece));
+        if (it != mRequests.end()) {
+            auto latency = static_cast<double>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now() - it->second).count());
+            mLatency = mLatency < 0 ? latency : mLatency + LATENCY_SMOOTHING * (latency - mLatency);
+            mRequests.erase(it);
+        }
+        mReceivedBytes += pBuf.size();
+        return false;
+    }
+
+    bool StreamingPeerPlugin::on_reject(const libtorrent::peer_request &pRequest) {
+        mRequests.erase(get_request_key(pRequest));
+        return false;
+    }
+
+    void StreamingPeerPlugin::sent_cancel(const libtorrent::peer_request &pRequest) {
+        mRequests.erase(get_request_key(pRequest));
+    }
+
+    void StreamingPeerPlugin::tick() {
+        // Ticks happen once per second, so the bytes received since the last tick are the current rate
+        mThroughput += THROUGHPUT_SMOOTHING * (static_cast<double>(mReceivedBytes) - mThroughput);
+        mReceivedBytes = 0;
+    }
+
+    void StreamingPeerPlugin::clear_requests(libtorrent::piece_index_t pPiece) {
+        for (auto it = mRequests.begin(); it != mRequests.end();) {
+            if (get_request_piece(it->first) == static_cast<int>(pPiece)) {
+                it = mRequests.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    std::chrono::milliseconds StreamingPeerPlugin::oldest_request_age(
+            const std::unordered_set<int> &pPieces,
+            const std::chrono::steady_clock::time_point &pNow) const {
+        auto age = std::chrono::milliseconds::zero();
+        for (auto &request : mRequests) {
+            if (pPieces.count(get_request_piece(request.first)) > 0) {
+                age = std::max(age, std::chrono::duration_cast<std::chrono::milliseconds>(pNow - request.second));
+            }
+        }
+        return age;
+    }
+
+    StreamingPlugin::StreamingPlugin(std::string pInfoHash, std::shared_ptr<spdlog::logger> pLogger)
+            : mInfoHash(std::move(pInfoHash)),
+              mLogger(std::move(pLogger)) {}
+
+    std::shared_ptr<StreamingPlugin> StreamingPlugin::attach(libtorrent::add_torrent_params &pTorrentParams,
+                                                             const std::string &pInfoHash,
+                                                             std::shared_ptr<spdlog::logger> pLogger) {
+        auto plugin = std::make_shared<StreamingPlugin>(pInfoHash, std::move(pLogger));
+        // The user data argument type differs between libtorrent versions
+        pTorrentParams.extensions.emplace_back([plugin](const libtorrent::torrent_handle &, auto) {
+            return std::static_pointer_cast<libtorrent::torrent_plugin>(plugin);
+        });
+        return plugin;
+    }
+
+    std::shared_ptr<libtorrent::peer_plugin> StreamingPlugin::new_connection(
+            const libtorrent::peer_connection_handle &pHandle) {
+        auto peer = std::make_shared<StreamingPeerPlugin>(pHandle);
+        mPeers.emplace_back(peer);
+        return peer;
+    }
+
+    void StreamingPlugin::on_piece_pass(libtorrent::piece_index_t pPiece) {
+        for (auto &weakPeer : mPeers) {
+            if (auto peer = weakPeer.lock()) {
+                peer->clear_requests(pPiece);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mLatePiecesMutex);
+        mLatePieces.erase(static_cast<int>(pPiece));
+    }
+
+    void StreamingPlugin::add_late_piece(libtorrent::piece_index_t pPiece) {
+        std::lock_guard<std::mutex> lock(mLatePiecesMutex);
+        if (mLatePieces.size() < MAX_LATE_PIECES) {
+            mLatePieces.insert(static_cast<int>(pPiece));
+        }
+    }
+
+    void StreamingPlugin::remove_late_piece(libtorrent::piece_index_t pPiece) {
+        std::lock_guard<std::mutex> lock(mLatePiecesMutex);
+        mLatePieces.erase(static_cast<int>(pPiece));
+    }
+
+    void StreamingPlugin::tick() {
+        std::vector<std::shared_ptr<StreamingPeerPlugin>> peers;
+        peers.reserve(mPeers.size());
+        for (auto it = mPeers.begin(); it != mPeers.end();) {
+            if (auto peer = it->lock()) {
+                peers.push_back(std::move(peer));
+                ++it;
+            } else {
+                it = mPeers.erase(it);
+            }
+        }
+
+        std::unordered_set<int> latePieces;
+        {
+            std::lock_guard<std::mutex> lock(mLatePiecesMutex);
+            latePieces = mLatePieces;
+        }
+
+        if (!latePieces.empty()) {
+            evict_slow_peers(peers, latePieces);
+        }
+    }
+
+    void StreamingPlugin::evict_slow_peers(const std::vector<std::shared_ptr<StreamingPeerPlugin>> &pPeers,
+                                           const std::unordered_set<int> &pLatePieces) const {
+        auto evictions = std::min<int>(MAX_EVICTIONS_PER_TICK, static_cast<int>(pPeers.size()) - MIN_CONNECTED_PEERS);
+        if (evictions <= 0) {
+            return;
+        }
+
+        std::vector<double> latencies;
+        for (auto &peer : pPeers) {
+            if (peer->get_latency() >= 0) {
+                latencies.push_back(peer->get_latency());
+            }
+        }
+
+        auto slowRequestAge = std::chrono::milliseconds(MIN_SLOW_REQUEST_AGE);
+        if (!latencies.empty()) {
+            auto median = latencies.begin() + latencies.size() / 2;
+            std::nth_element(latencies.begin(), median, latencies.end());
+            slowRequestAge = std::max(slowRequestAge, std::chrono::milliseconds(
+                    static_cast<std::int64_t>(SLOW_PEER_FACTOR * *median)));
+        }
+
+        // Peers holding blocks of late pieces for the longest are evicted first
+        auto now = std::chrono::steady_clock::now();
+        std::vector<std::pair<std::chrono::milliseconds, std::shared_ptr<StreamingPeerPlugin>>> slowPeers;
+        for (auto &peer : pPeers) {
+            auto age = peer->oldest_request_age(pLatePieces, now);
+            if (age > slowRequestAge && !peer->get_handle().is_disconnecting()) {
+                slowPeers.emplace_back(age, peer);
+            }
+        }
+
+        std::sort(slowPeers.begin(), slowPeers.end(), [](const auto &pA, const auto &pB) {
+            return pA.first > pB.first;
+        });
+
+        for (int i = 0; i < evictions && i < static_cast<int>(slowPeers.size()); i++) {
+            auto &peer = slowPeers[i].second;
+            auto &remote = peer->get_handle().remote();
+            mLogger->debug("operation=evict_slow_peers, message='Disconnecting slow peer', peer={}:{}, "
+                           "requestAge={}, latency={}, throughput={}, infoHash={}",
+                           remote.address().to_string(), remote.port(), slowPeers[i].first.count(),
+                           peer->get_latency(), peer->get_throughput(), mInfoHash);
+            peer->get_handle().disconnect(libtorrent::errors::timed_out, libtorrent::operation_t::bittorrent);
+        }
+    }
+
+}}
@@ -0,0 +1,98 @@
+#ifndef TORREST_STREAMING_PLUGIN_H
+#define TORREST_STREAMING_PLUGIN_H
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "libtorrent/add_torrent_params.hpp"
+#include "libtorrent/extensions.hpp"
+#include "libtorrent/peer_connection_handle.hpp"
+#include "spdlog/spdlog.h"
+
+namespace torrest { namespace bittorrent {
+
+    /**
+     * Measures the block latency and throughput of a single peer, based on the requests sent
+     * to it and the blocks it delivers.
+     */
+    class StreamingPeerPlugin : public libtorrent::peer_plugin {
+    public:
+        explicit StreamingPeerPlugin(libtorrent::peer_connection_handle pHandle);
+
+        void sent_request(const libtorrent::peer_request &pRequest) override;
+
+        bool on_piece(const libtorrent::peer_request &pPiece, libtorrent::span<char const> pBuf) override;
+
+        bool on_reject(const libtorrent::peer_request &pRequest) override;
+
+        void sent_cancel(const libtorrent::peer_request &pRequest) override;
+
+        void tick() override;
+
+        void clear_requests(libtorrent::piece_index_t pPiece);
+
+        std::chrono::milliseconds oldest_request_age(const std::unordered_set<int> &pPieces,
+                                                     const std::chrono::steady_clock::time_point &pNow) const;
+
+        double get_latency() const {
+            return mLatency;
+        }
+
+        double get_throughput() const {
+            return mThroughput;
+        }
+
+        libtorrent::peer_connection_handle &get_handle() {
+            return mHandle;
+        }
+
+    private:
+        libtorrent::peer_connection_handle mHandle;
+        std::unordered_map<std::int64_t, std::chrono::steady_clock::time_point> mRequests;
+        std::int64_t mReceivedBytes;
+        double mLatency;
+        double mThroughput;
+    };
+
+    /**
+     * Torrest torrent plugin for streaming. It keeps track of the peers latency and throughput
+     * and disconnects slow peers holding blocks of late streamed pieces, so that those blocks
+     * are requested again from the fastest peers, while slow peers are kept otherwise.
+     */
+    class StreamingPlugin : public libtorrent::torrent_plugin {
+    public:
+        StreamingPlugin(std::string pInfoHash, std::shared_ptr<spdlog::logger> pLogger);
+
+        static std::shared_ptr<StreamingPlugin> attach(libtorrent::add_torrent_params &pTorrentParams,
+                                                       const std::string &pInfoHash,
+                                                       std::shared_ptr<spdlog::logger> pLogger);
+
+        std::shared_ptr<libtorrent::peer_plugin> new_connection(const libtorrent::peer_connection_handle &pHandle) override;
+
+        void on_piece_pass(libtorrent::piece_index_t pPiece) override;
+
+        void tick() override;
+
+        void add_late_piece(libtorrent::piece_index_t pPiece);
+
+        void remove_late_piece(libtorrent::piece_index_t pPiece);
+
+    private:
+        void evict_slow_peers(const std::vector<std::shared_ptr<StreamingPeerPlugin>> &pPeers,
+                              const std::unordered_set<int> &pLatePieces) const;
+
+        std::string mInfoHash;
+        std::shared_ptr<spdlog::logger> mLogger;
+        std::vector<std::weak_ptr<StreamingPeerPlugin>> mPeers;
+        std::mutex mLatePiecesMutex;
+        std::unordered_set<int> mLatePieces;
+    };
+
+}}
+
+#endif //TORREST_STREAMING_PLUGIN_H
@@ -1,26 +1,89 @@
 #include "torrent.h"
 
+#include "boost/algorithm/string.hpp"
 #include "boost/filesystem.hpp"
 #include "libtorrent/torrent_info.hpp"
 #include "libtorrent/torrent_status.hpp"
 
 #include "exceptions.h"
 #include "file.h"
+#include "file_table.h"
 #include "service.h"
+#include "streaming_plugin.h"
 #include "utils/enum_fmt.h"
+#include "utils/mime.h"
+#include "utils/utils.h"
+
+#define BLOCK_SIZE 0x4000
+#define DEADLINE_GRACE_PERIOD 2000
+#define MAX_DEADLINE_ESCALATIONS 2
+#define REANNOUNCE_INTERVAL 30
+#define PREFETCH_END_SIZE (10 * 1024 * 1024)
+#define MAX_COMPANION_FILE_SIZE (10 * 1024 * 1024)
+#define PREWARM_BEHIND_SIZE (1024 * 1024)
+
+namespace {
+
+    int find_next_video_file(const torrest::bittorrent::FileTable &pFileTable, int pIndex) {
+        auto directory = pFileTable.directory_id(pIndex);
+        auto name = pFileTable.file_name(pIndex);
+        auto next = -1;
+        std::string nextName;
+
+        for (int i = 0; i < pFileTable.num_files(); i++) {
+            if (i == pIndex || pFileTable.directory_id(i) != directory) {
+                continue;
+            }
+            auto fileName = pFileTable.file_name(i);
+            if (torrest::utils::is_video_file(fileName) && torrest::utils::natural_less(name, fileName)
+                && (next < 0 || torrest::utils::natural_less(fileName, nextName))) {
+                next = i;
+                nextName = std::move(fileName);
+            }
+        }
+
+        return next;
+    }
+
+    bool is_companion_file(const std::string &pVideoStem, const std::string &pFileName) {
+        static const std::unordered_set<std::string> extensions = {
+                ".srt", ".ass", ".ssa", ".sub", ".idx", ".vtt", ".smi", ".nfo"};
+
+        auto fileName = boost::algorithm::to_lower_copy(pFileName);
+        auto extension = boost::filesystem::path(fileName).extension().string();
+        // Companion files share the video stem, possibly followed by a suffix such as a language
+        return extensions.count(extension) > 0
+               && torrest::utils::starts_with(fileName, pVideoStem)
+               && (fileName.length() == pVideoStem.length() + extension.length()
+                   || fileName[pVideoStem.length()] == '.');
+    }
+
+}
 
 namespace torrest { namespace bittorrent {
 
     Torrent::Torrent(std::shared_ptr<ServiceSettings> pSettings,
                      libtorrent::torrent_handle pHandle,
                      std::string pInfoHash,
+                     bool pDownload,
+                     std::shared_ptr<StreamingPlugin> pPlugin,
+                     std::shared_ptr<MemoryBuffer> pMemoryBuffer,
                      std::shared_ptr<spdlog::logger> pLogger)
             : mLogger(std::move(pLogger)),
               mHandle(std::move(pHandle)),
+              mPlugin(std::move(pPlugin)),
+              mMemoryBuffer(std::move(pMemoryBuffer)),
               mSettings(std::move(pSettings)),
               mInfoHash(std::move(pInfoHash)),
               mHasMetadata(false),
-              mClosed(false) {
+              mClosed(false),
+              mDownloadOnMetadata(pDownload),
+              mBandwidthClass(bc_background),
+              mDownloadLimit(0),
+              mUploadLimit(0),
+              mStreamPromoted(false),
+              mSequentialDownload(false),
+              mQueuePosition(-1) {
 
         auto flags = mHandle.flags();
         auto status = mHandle.status(libtorrent::torrent_handle::query_name);
@@ -33,13 +96,24 @@ namespace torrest { namespace bittorrent {
         mLogger->debug("operation=handle_metadata_received");
         std::lock_guard<std::mutex> lock(mFilesMutex);
         auto torrentFile = mHandle.torrent_file();
-        auto files = torrentFile->files();
 
+        mFileTable = std::make_shared<const FileTable>(torrentFile->files());
         mFiles.clear();
-        for (int i = 0; i < torrentFile->num_files(); i++) {
-            mFiles.emplace_back(std::make_shared<File>(shared_from_this(), files, libtorrent::file_index_t(i)));
+
+        // Files are only created when accessed, so make sure we don't have individual pieces
+        // of unwanted files downloading (previously set by buffering) with a single call
+        auto priorities = mHandle.get_file_priorities();
+        priorities.resize(mFileTable->num_files(), libtorrent::default_priority);
+        if (!mDownloadOnMetadata.exchange(true)) {
+            std::fill(priorities.begin(), priorities.end(), libtorrent::dont_download);
+        }
+        if (std::find(priorities.begin(), priorities.end(), libtorrent::dont_download) != priorities.end()) {
+            mHandle.prioritize_files(priorities);
         }
 
+        // Resumed playback starts faster if the pieces around the last read positions are already there
+        prewarm_read_positions(*mFileTable);
+
         mHasMetadata = true;
     }
 
@@ -52,6 +126,25 @@ namespace torrest { namespace bittorrent {
         mPiecesCv.notify_all();
     }
 
+    void Torrent::fail_piece(libtorrent::piece_index_t pPiece) {
+        mLogger->trace("operation=fail_piece, piece={}", to_string(pPiece));
+        {
+            // Readers waiting for the piece fail right away instead of waiting for the timeout
+            std::lock_guard<std::mutex> lock(mPiecesMutex);
+            mFailedPieces.insert(pPiece);
+            mPiecesCv.notify_all();
+        }
+
+        if (mMemoryBuffer != nullptr && mMemoryBuffer->is_evicted(int(pPiece))) {
+            // Rechecking the torrent would drop every piece kept in memory, so only this piece is requested
+            // again urgently, which re-fetches it as long as libtorrent does not have it yet
+            mLogger->warn("operation=fail_piece, message='Piece evicted from memory', piece={}, infoHash={}",
+                          to_string(pPiece), mInfoHash);
+            mHandle.piece_priority(pPiece, libtorrent::top_priority);
+            set_piece_deadline(pPiece, 0);
+        }
+    }
+
     void Torrent::cleanup_pieces(const std::chrono::milliseconds &pExpiration) {
         mLogger->trace("operation=cleanup_pieces, expiration={}", pExpiration.count());
         auto now = std::chrono::steady_clock::now();
@@ -67,6 +160,10 @@ namespace torrest { namespace bittorrent {
 
     void Torrent::schedule_read_piece(libtorrent::piece_index_t pPiece) {
         mLogger->trace("operation=schedule_read_piece, piece={}", to_string(pPiece));
+        {
+            std::lock_guard<std::mutex> lock(mPiecesMutex);
+            mFailedPieces.erase(pPiece);
+        }
         mHandle.read_piece(pPiece);
     }
 
@@ -78,7 +175,9 @@ namespace torrest { namespace bittorrent {
 
         auto it = mPieces.find(pPiece);
         while (it == mPieces.end()) {
-            if (!pWaitUntil) {
+            if (mFailedPieces.count(pPiece) > 0) {
+                throw PieceException("Failed reading piece");
+            } else if (!pWaitUntil) {
                 mPiecesCv.wait(lock);
             } else if (std::chrono::steady_clock::now() >= *pWaitUntil) {
                 mLogger->error("operation=read_scheduled_piece, message='Timed out waiting for piece', piece={}",
@@ -140,6 +239,7 @@ namespace torrest { namespace bittorrent {
         mHandle.unset_flags(libtorrent::torrent_flags::auto_managed);
         mHandle.pause(libtorrent::torrent_handle::clear_disk_cache);
         mPaused = true;
+        mStreamPromoted = false;
     }
 
     void Torrent::resume() {
@@ -147,6 +247,7 @@ namespace torrest { namespace bittorrent {
         std::lock_guard<std::mutex> lock(mMutex);
         mHandle.set_flags(libtorrent::torrent_flags::auto_managed);
         mPaused = false;
+        mStreamPromoted = false;
     }
 
     bool Torrent::is_paused() const {
@@ -159,12 +260,56 @@ namespace torrest { namespace bittorrent {
 
     void Torrent::set_priority(libtorrent::download_priority_t pPriority) {
         mLogger->debug("operation=set_priority, priority={}", to_string(pPriority));
+        check_download_allowed(pPriority);
         if (!mHasMetadata.load()) {
             throw NoMetadataException("No metadata");
         }
-        std::lock_guard<std::mutex> lock(mFilesMutex);
-        for (auto &file : mFiles) {
-            file->set_priority(pPriority);
+        auto fileTable = get_file_table();
+        std::vector<libtorrent::download_priority_t> priorities(fileTable->num_files(), pPriority);
+        mHandle.prioritize_files(priorities);
+        mResumeDataDirty = true;
+
+        // Files that were already created must also reset their buffering state
+        for (auto &file : get_materialized_files()) {
+            file->reset_priority(pPriority);
+        }
+    }
+
+    int Torrent::set_priority(libtorrent::download_priority_t pPriority, const std::string &pPrefix) {
+        mLogger->debug("operation=set_priority, priority={}, prefix='{}'", to_string(pPriority), pPrefix);
+        check_download_allowed(pPriority);
+        auto fileTable = get_file_table();
+        auto priorities = mHandle.get_file_priorities();
+        priorities.resize(fileTable->num_files(), libtorrent::default_priority);
+        std::vector<bool> matches(fileTable->num_files(), false);
+        int count = 0;
+
+        for (int i = 0; i < fileTable->num_files(); i++) {
+            if (fileTable->file_path(i).rfind(pPrefix, 0) == 0) {
+                priorities[i] = pPriority;
+                matches[i] = true;
+                count++;
+            }
+        }
+
+        if (count > 0) {
+            mHandle.prioritize_files(priorities);
+            mResumeDataDirty = true;
+
+            for (auto &file : get_materialized_files()) {
+                if (matches[int(file->mIndex)]) {
+                    file->reset_priority(pPriority);
+                }
+            }
+        }
+
+        return count;
+    }
+
+    void Torrent::check_download_allowed(libtorrent::download_priority_t pPriority) const {
+        // Torrents kept in memory only fetch the pieces around their buffers and readers
+        if (mMemoryBuffer != nullptr && pPriority != libtorrent::dont_download) {
+            throw MemoryStorageException("Torrents kept in memory can't be downloaded");
         }
     }
 
@@ -183,6 +328,8 @@ namespace torrest { namespace bittorrent {
         std::lock_guard<std::mutex> lock(mMutex);
         auto status = mHandle.status();
         auto peers = status.num_peers - status.num_seeds;
+        auto hits = mDeadlineHits.load();
+        auto misses = mDeadlineMisses.load();
 
         return TorrentStatus{
                 .total=status.total,
@@ -204,6 +351,10 @@ namespace torrest { namespace bittorrent {
                 .active_time=status.active_duration.count(),
                 .all_time_download=status.all_time_download,
                 .all_time_upload=status.all_time_upload,
+                .deadline_hits=hits,
+                .deadline_misses=misses,
+                .deadline_hit_ratio=hits + misses > 0
+                                    ? 100 * static_cast<double>(hits) / static_cast<double>(hits + misses) : 100,
         };
     }
 
@@ -214,8 +365,8 @@ namespace torrest { namespace bittorrent {
 #ifdef TORREST_ENABLE_TORRENT_BUFFERING_STATUS
         if (state == downloading) {
             std::lock_guard<std::mutex> filesLock(mFilesMutex);
-            for (auto &file : mFiles) {
-                if (file->mBuffering.load()) {
+            for (auto &entry : mFiles) {
+                if (entry.second->mBuffering.load()) {
                     state = buffering;
                     break;
                 }
@@ -273,28 +424,256 @@ namespace torrest { namespace bittorrent {
         return state;
     }
 
-    std::vector<std::shared_ptr<File>> Torrent::get_files() const {
-        mLogger->trace("operation=get_files");
+    std::shared_ptr<const FileTable> Torrent::get_file_table() const {
         if (!mHasMetadata.load()) {
             throw NoMetadataException("No metadata");
         }
         std::lock_guard<std::mutex> lock(mFilesMutex);
-        return mFiles;
+        return mFileTable;
     }
 
-    std::shared_ptr<File> Torrent::get_file(int pIndex) const {
+    std::vector<std::shared_ptr<File>> Torrent::get_materialized_files() const {
+        std::lock_guard<std::mutex> lock(mFilesMutex);
+        std::vector<std::shared_ptr<File>> files;
+        files.reserve(mFiles.size());
+        for (auto &entry : mFiles) {
+            files.push_back(entry.second);
+        }
+        return files;
+    }
+
+    std::vector<FileInfo> Torrent::get_files_info() const {
+        mLogger->trace("operation=get_files_info");
+        auto fileTable = get_file_table();
+        std::vector<FileInfo> files;
+        files.reserve(fileTable->num_files());
+
+        for (int i = 0; i < fileTable->num_files(); i++) {
+            files.push_back(FileInfo{
+                    .id=i,
+                    .length=fileTable->file_size(i),
+                    .path=fileTable->file_path(i),
+                    .name=fileTable->file_name(i),
+            });
+        }
+
+        return files;
+    }
+
+    std::vector<FileStatus> Torrent::get_files_status() const {
+        mLogger->trace("operation=get_files_status");
+        auto fileTable = get_file_table();
+        std::unordered_map<int, std::shared_ptr<File>> materializedFiles;
+        {
+            std::lock_guard<std::mutex> lock(mFilesMutex);
+            materializedFiles = mFiles;
+        }
+
+        // Query the progress and priorities of all files at once, instead of once per file
+        std::vector<std::int64_t> progress;
+        mHandle.file_progress(progress, libtorrent::torrent_handle::piece_granularity);
+        auto priorities = mHandle.get_file_priorities();
+        auto torrentState = get_torrent_state();
+
+        std::vector<FileStatus> files;
+        files.reserve(fileTable->num_files());
+
+        for (int i = 0; i < fileTable->num_files(); i++) {
+            auto completed = progress.at(i);
+            auto it = materializedFiles.find(i);
+
+            if (it != materializedFiles.end()) {
+                files.push_back(it->second->get_status(torrentState, completed));
+            } else {
+                auto size = fileTable->file_size(i);
+                auto priority = priorities.at(i);
+                files.push_back(FileStatus{
+                        .total=size,
+                        .total_done=completed,
+                        .progress=File::get_progress(completed, size),
+                        .priority=std::uint8_t(priority),
+                        .buffering_total=0,
+                        .buffering_progress=100,
+                        .state=File::get_state(torrentState, false, priority, completed, size),
+                });
+            }
+        }
+
+        return files;
+    }
+
+    std::shared_ptr<File> Torrent::get_file(int pIndex) {
         mLogger->trace("operation=get_file, index={}", pIndex);
         if (!mHasMetadata.load()) {
             throw NoMetadataException("No metadata");
         }
         std::lock_guard<std::mutex> lock(mFilesMutex);
-        if (pIndex < 0 || pIndex >= mFiles.size()) {
+        if (pIndex < 0 || pIndex >= mFileTable->num_files()) {
             throw InvalidFileIndexException("No such file index");
         }
-        return mFiles.at(pIndex);
+
+        auto it = mFiles.find(pIndex);
+        if (it == mFiles.end()) {
+            it = mFiles.emplace(pIndex, std::make_shared<File>(
+                    shared_from_this(), mFileTable, libtorrent::file_index_t(pIndex))).first;
+        }
+        return it->second;
+    }
+
+    void Torrent::prefetch_companion_files(int pIndex) {
+        // Torrents kept in memory only download the pieces being read
+        if (mMemoryBuffer != nullptr) {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mFilesMutex);
+            if (!mCompanionsPrefetched.insert(pIndex).second) {
+                return;
+            }
+        }
+
+        auto fileTable = get_file_table();
+        auto directory = fileTable->directory_id(pIndex);
+        auto stem = boost::algorithm::to_lower_copy(
+                boost::filesystem::path(fileTable->file_name(pIndex)).stem().string());
+
+        for (int i = 0; i < fileTable->num_files(); i++) {
+            if (i == pIndex || fileTable->directory_id(i) != directory
+                || fileTable->file_size(i) > MAX_COMPANION_FILE_SIZE
+                || !is_companion_file(stem, fileTable->file_name(i))) {
+                continue;
+            }
+
+            libtorrent::file_index_t index(i);
+            if (mHandle.file_priority(index) < libtorrent::top_priority) {
+                mLogger->debug("operation=prefetch_companion_files, message='Prefetching companion file', "
+                               "index={}, companion={}, infoHash={}", pIndex, i, mInfoHash);
+                mHandle.file_priority(index, libtorrent::top_priority);
+                mResumeDataDirty = true;
+            }
+        }
+    }
+
+    void Torrent::prefetch_next_file(int pIndex) {
+        // Torrents kept in memory only download the pieces being read
+        if (mMemoryBuffer != nullptr) {
+            return;
+        }
+
+        auto fileTable = get_file_table();
+        auto next = find_next_video_file(*fileTable, pIndex);
+        if (next < 0) {
+            mLogger->debug("operation=prefetch_next_file, message='No next file', index={}, infoHash={}",
+                           pIndex, mInfoHash);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mFilesMutex);
+            if (!mPrefetchedFiles.insert(next).second) {
+                return;
+            }
+        }
+
+        mLogger->debug("operation=prefetch_next_file, message='Prefetching next file', index={}, next={}, "
+                       "infoHash={}", pIndex, next, mInfoHash);
+
+        auto offset = fileTable->file_offset(next);
+        auto size = fileTable->file_size(next);
+        auto startSize = std::min(size, std::max(size / 200, mSettings->load()->buffer_size));
+        auto endSize = std::min<std::int64_t>(size - startSize, PREFETCH_END_SIZE);
+        prefetch_ranges(*fileTable, {{offset, startSize}, {offset + size - endSize, endSize}});
+    }
+
+    void Torrent::prefetch_ranges(const FileTable &pFileTable,
+                                  const std::vector<std::pair<std::int64_t, std::int64_t>> &pRanges) {
+        // Torrents kept in memory only download the pieces being read
+        if (mMemoryBuffer != nullptr) {
+            return;
+        }
+
+        auto pieceLength = pFileTable.piece_length();
+        auto priorities = mHandle.get_piece_priorities();
+        std::vector<std::pair<libtorrent::piece_index_t, libtorrent::download_priority_t>> changes;
+
+        // Only pieces not wanted yet are requested, at low priority, so that nothing else is slowed down
+        for (auto &range : pRanges) {
+            if (range.second <= 0) {
+                continue;
+            }
+            auto endPiece = static_cast<int>((range.first + range.second - 1) / pieceLength);
+            for (auto p = static_cast<int>(range.first / pieceLength); p <= endPiece; p++) {
+                if (priorities.at(p) == libtorrent::dont_download) {
+                    priorities.at(p) = libtorrent::low_priority;
+                    changes.emplace_back(libtorrent::piece_index_t(p), libtorrent::low_priority);
+                }
+            }
+        }
+
+        if (!changes.empty()) {
+            mHandle.prioritize_pieces(changes);
+        }
+    }
+
+    void Torrent::update_read_position(int pIndex, std::int64_t pOffset, std::int64_t pSize) {
+        std::lock_guard<std::mutex> lock(mReadPositionsMutex);
+        // Files read until the end no longer need to be resumed
+        if (pOffset >= pSize) {
+            mReadPositions.erase(pIndex);
+        } else {
+            mReadPositions[pIndex] = pOffset;
+        }
+        mReadPositionsDirty = true;
+    }
+
+    void Torrent::set_read_positions(std::map<int, std::int64_t> pPositions) {
+        std::lock_guard<std::mutex> lock(mReadPositionsMutex);
+        mReadPositions = std::move(pPositions);
+    }
+
+    bool Torrent::get_dirty_read_positions(std::map<int, std::int64_t> &pPositions) {
+        std::lock_guard<std::mutex> lock(mReadPositionsMutex);
+        if (!mReadPositionsDirty) {
+            return false;
+        }
+        pPositions = mReadPositions;
+        mReadPositionsDirty = false;
+        return true;
+    }
+
+    void Torrent::prewarm_read_positions(const FileTable &pFileTable) {
+        auto bufferSize = mSettings->load()->buffer_size;
+        std::vector<std::pair<std::int64_t, std::int64_t>> ranges;
+
+        {
+            std::lock_guard<std::mutex> lock(mReadPositionsMutex);
+            for (auto &position : mReadPositions) {
+                if (position.first >= pFileTable.num_files()) {
+                    continue;
+                }
+                auto size = pFileTable.file_size(position.first);
+                auto start = std::max<std::int64_t>(position.second - PREWARM_BEHIND_SIZE, 0);
+                if (start < size) {
+                    ranges.emplace_back(pFileTable.file_offset(position.first) + start,
+                                        std::min(size - start, position.second - start + bufferSize));
+                }
+            }
+        }
+
+        if (!ranges.empty()) {
+            mLogger->debug("operation=prewarm_read_positions, message='Prefetching last read positions', "
+                           "count={}, infoHash={}", ranges.size(), mInfoHash);
+            prefetch_ranges(pFileTable, ranges);
+        }
     }
 
     void Torrent::check_available_space(const std::string &pPath) {
+        if (mMemoryBuffer != nullptr) {
+            // Nothing is written to disk
+            return;
+        }
+
         mLogger->debug("operation=check_available_space, message='Checking available space', infoHash={}", mInfoHash);
 
         auto status = mHandle.status(libtorrent::torrent_handle::query_accurate_download_counters
@@ -314,46 +693,66 @@ namespace torrest { namespace bittorrent {
         }
     }
 
-    void Torrent::check_save_resume_data() const {
+    bool Torrent::check_save_resume_data() {
         mLogger->trace("operation=check_save_resume_data, infoHash={}", mInfoHash);
-        if (mHandle.is_valid() && mHasMetadata.load() && mHandle.need_save_resume_data()) {
+        // Torrents kept in memory are not persisted
+        if (mMemoryBuffer == nullptr && mHandle.is_valid() && mHasMetadata.load()
+            && (mResumeDataDirty.exchange(false) || mHandle.need_save_resume_data())) {
             mHandle.save_resume_data(libtorrent::torrent_handle::save_info_dict);
+            return true;
         }
+        return false;
     }
 
-    std::int64_t Torrent::get_bytes_missing(const std::vector<libtorrent::piece_index_t> &pPieces) const {
-        mLogger->trace("operation=get_bytes_missing");
-        auto torrentFile = mHandle.torrent_file();
-        std::int64_t missing = 0;
-
-        for (auto &piece : pPieces) {
-            if (!mHandle.have_piece(piece)) {
-                missing += torrentFile->piece_size(piece);
+    void Torrent::handle_piece_finished(libtorrent::piece_index_t pPiece) {
+        {
+            std::lock_guard<std::mutex> lock(mDeadlinesMutex);
+            auto it = mDeadlinePieces.find(int(pPiece));
+            if (it != mDeadlinePieces.end()) {
+                record_deadline(it->second, std::chrono::steady_clock::now());
+                mDeadlinePieces.erase(it);
             }
         }
 
-        if (missing > 0) {
-            std::vector<libtorrent::partial_piece_info> queue;
-            mHandle.get_download_queue(queue);
+        std::lock_guard<std::mutex> lock(mFilesMutex);
+        for (auto &entry : mFiles) {
+            entry.second->handle_piece_finished(pPiece);
+        }
+    }
 
-            for (auto &qPiece : queue) {
-                if (std::find(pPieces.begin(), pPieces.end(), qPiece.piece_index) != pPieces.end()) {
-                    for (int i = 0; i < qPiece.blocks_in_piece; i++) {
-                        missing -= qPiece.blocks[i].bytes_progress;
-                    }
-                }
-            }
+    void Torrent::handle_block_finished(libtorrent::piece_index_t pPiece, int pBlock) const {
+        std::lock_guard<std::mutex> lock(mFilesMutex);
+        if (mFiles.empty()) {
+            return;
+        }
+        auto pieceSize = mFileTable->piece_size(int(pPiece));
+        auto blockSize = std::min(BLOCK_SIZE, pieceSize - pBlock * BLOCK_SIZE);
+        for (auto &entry : mFiles) {
+            entry.second->handle_block_finished(pPiece, blockSize);
+        }
+    }
+
+    void Torrent::handle_hash_failed(libtorrent::piece_index_t pPiece) const {
+        std::lock_guard<std::mutex> lock(mFilesMutex);
+        for (auto &entry : mFiles) {
+            entry.second->handle_hash_failed(pPiece);
         }
+    }
 
-        return missing;
+    void Torrent::invalidate_buffering_state() const {
+        mLogger->trace("operation=invalidate_buffering_state, infoHash={}", mInfoHash);
+        std::lock_guard<std::mutex> lock(mFilesMutex);
+        for (auto &entry : mFiles) {
+            entry.second->mBufferResync = true;
+        }
     }
 
     bool Torrent::verify_buffering_state() const {
         std::lock_guard<std::mutex> lock(mFilesMutex);
         bool has_files_buffering = false;
 
-        for (auto &file : mFiles) {
-            if (file->verify_buffering_state()) {
+        for (auto &entry : mFiles) {
+            if (entry.second->verify_buffering_state()) {
                 has_files_buffering = true;
             }
         }
@@ -361,4 +760,190 @@ namespace torrest { namespace bittorrent {
         return has_files_buffering;
     }
 
+    bool Torrent::has_readers() const {
+        return mReaders.load() > 0;
+    }
+
+    void Torrent::set_bandwidth_class(BandwidthClass pClass, int pDownloadLimit, int pUploadLimit) {
+        if (mBandwidthClass != pClass) {
+            mLogger->debug("operation=set_bandwidth_class, class={}, previousClass={}, infoHash={}",
+                           int(pClass), int(mBandwidthClass), mInfoHash);
+            mBandwidthClass = pClass;
+        }
+
+        // libtorrent backs per torrent limits with a peer class of its own
+        if (mDownloadLimit != pDownloadLimit) {
+            mHandle.set_download_limit(pDownloadLimit);
+            mDownloadLimit = pDownloadLimit;
+        }
+        if (mUploadLimit != pUploadLimit) {
+            mHandle.set_upload_limit(pUploadLimit);
+            mUploadLimit = pUploadLimit;
+        }
+    }
+
+    void Torrent::set_stream_promotion(bool pPromote) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mPaused || mStreamPromoted == pPromote) {
+            return;
+        }
+
+        if (pPromote) {
+            if (!(mHandle.flags() & libtorrent::torrent_flags::auto_managed)) {
+                return;
+            }
+
+            mLogger->debug("operation=set_stream_promotion, message='Promoting streamed torrent', infoHash={}",
+                           mInfoHash);
+            // Exempt the torrent from the queuing mechanism so it is not queued while being streamed
+            mQueuePosition = mHandle.queue_position();
+            mHandle.unset_flags(libtorrent::torrent_flags::auto_managed);
+            mHandle.resume();
+            mHandle.queue_position_top();
+        } else {
+            mLogger->debug("operation=set_stream_promotion, message='Restoring torrent queue position', "
+                           "queuePosition={}, infoHash={}", static_cast<int>(mQueuePosition), mInfoHash);
+            mHandle.set_flags(libtorrent::torrent_flags::auto_managed);
+            if (static_cast<int>(mQueuePosition) >= 0) {
+                mHandle.queue_position_set(mQueuePosition);
+            }
+        }
+
+        mStreamPromoted = pPromote;
+    }
+
+    void Torrent::set_sequential_download(bool pSequential) {
+        if (mSequentialDownload != pSequential) {
+            mLogger->debug("operation=set_sequential_download, sequential={}, infoHash={}", pSequential, mInfoHash);
+            if (pSequential) {
+                mHandle.set_flags(libtorrent::torrent_flags::sequential_download);
+            } else {
+                mHandle.unset_flags(libtorrent::torrent_flags::sequential_download);
+            }
+            mSequentialDownload = pSequential;
+        }
+    }
+
+    void Torrent::set_piece_deadline(libtorrent::piece_index_t pPiece, int pDeadline) {
+        auto due = std::chrono::steady_clock::now() + std::chrono::milliseconds(pDeadline);
+        mHandle.set_piece_deadline(pPiece, pDeadline);
+
+        std::lock_guard<std::mutex> lock(mDeadlinesMutex);
+        auto it = mDeadlinePieces.find(int(pPiece));
+        if (it == mDeadlinePieces.end()) {
+            mDeadlinePieces.emplace(int(pPiece), DeadlinePiece{due, 0});
+        } else if (due < it->second.due) {
+            it->second.due = due;
+        }
+    }
+
+    void Torrent::set_deadline_window(const void *pOwner, int pStartPiece, int pEndPiece) {
+        set_deadline_windows(pOwner, {{pStartPiece, pEndPiece}});
+    }
+
+    void Torrent::set_deadline_windows(const void *pOwner, std::vector<std::pair<int, int>> pWindows) {
+        std::lock_guard<std::mutex> lock(mDeadlinesMutex);
+        mDeadlineWindows[pOwner] = std::move(pWindows);
+    }
+
+    void Torrent::remove_deadline_windows(const void *pOwner) {
+        std::lock_guard<std::mutex> lock(mDeadlinesMutex);
+        mDeadlineWindows.erase(pOwner);
+    }
+
+    bool Torrent::is_in_deadline_window(int pPiece) const {
+        for (auto &entry : mDeadlineWindows) {
+            for (auto &window : entry.second) {
+                if (pPiece >= window.first && pPiece <= window.second) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    void Torrent::drop_deadline_piece(libtorrent::piece_index_t pPiece) {
+        // The piece was not downloaded, so it must no longer be chased by the streaming plugin
+        if (mPlugin) {
+            mPlugin->remove_late_piece(pPiece);
+        }
+    }
+
+    void Torrent::record_deadline(const DeadlinePiece &pDeadlinePiece,
+                                  const std::chrono::steady_clock::time_point &pNow) {
+        if (pNow <= pDeadlinePiece.due + std::chrono::milliseconds(DEADLINE_GRACE_PERIOD)) {
+            mDeadlineHits++;
+        } else {
+            mDeadlineMisses++;
+        }
+    }
+
+    void Torrent::check_deadlines() {
+        {
+            std::lock_guard<std::mutex> lock(mDeadlinesMutex);
+            if (mDeadlinePieces.empty()) {
+                return;
+            }
+        }
+
+        // Query the pieces state once instead of once per deadline piece
+        auto status = mHandle.status(libtorrent::torrent_handle::query_pieces);
+        auto priorities = mHandle.get_piece_priorities();
+        auto now = std::chrono::steady_clock::now();
+        auto reannounce = false;
+        std::lock_guard<std::mutex> lock(mDeadlinesMutex);
+
+        for (auto it = mDeadlinePieces.begin(); it != mDeadlinePieces.end();) {
+            libtorrent::piece_index_t piece(it->first);
+            auto &deadlinePiece = it->second;
+
+            // Finished pieces whose alert was missed, or pieces that are no longer wanted
+            if (status.is_seeding || (!status.pieces.empty() && status.pieces.get_bit(piece))) {
+                record_deadline(deadlinePiece, now);
+                it = mDeadlinePieces.erase(it);
+                continue;
+            } else if (priorities.at(it->first) == libtorrent::dont_download) {
+                drop_deadline_piece(piece);
+                it = mDeadlinePieces.erase(it);
+                continue;
+            } else if (!is_in_deadline_window(it->first)) {
+                // Pieces left behind by a reader seek or a buffering reset are no longer time critical
+                mLogger->trace("operation=check_deadlines, message='Dropping abandoned piece', piece={}, "
+                               "infoHash={}", it->first, mInfoHash);
+                mHandle.reset_piece_deadline(piece);
+                drop_deadline_piece(piece);
+                it = mDeadlinePieces.erase(it);
+                continue;
+            }
+
+            // Each escalation is given another grace period before escalating again
+            auto overdue = deadlinePiece.due
+                           + std::chrono::milliseconds(DEADLINE_GRACE_PERIOD * (deadlinePiece.escalations + 1));
+            if (now > overdue && deadlinePiece.escalations < MAX_DEADLINE_ESCALATIONS) {
+                deadlinePiece.escalations++;
+                mLogger->debug("operation=check_deadlines, message='Escalating late piece', piece={}, "
+                               "escalations={}, infoHash={}", it->first, deadlinePiece.escalations, mInfoHash);
+                // A time critical piece past its deadline has its busy blocks requested from other peers
+                mHandle.piece_priority(piece, libtorrent::top_priority);
+                mHandle.set_piece_deadline(piece, 0);
+                // Slow peers holding blocks of this piece are disconnected by the streaming plugin
+                if (mPlugin) {
+                    mPlugin->add_late_piece(piece);
+                }
+                if (deadlinePiece.escalations == MAX_DEADLINE_ESCALATIONS) {
+                    reannounce = true;
+                }
+            }
+
+            ++it;
+        }
+
+        if (reannounce && now - mLastReannounce >= std::chrono::seconds(REANNOUNCE_INTERVAL)) {
+            mLogger->debug("operation=check_deadlines, message='Looking for more peers', infoHash={}", mInfoHash);
+            mHandle.force_reannounce();
+            mHandle.force_dht_announce();
+            mLastReannounce = now;
+        }
+    }
+
 }}
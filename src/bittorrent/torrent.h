@@ -2,9 +2,13 @@
 #define TORREST_TORRENT_H
 
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "boost/optional.hpp"
 #include "boost/shared_array.hpp"
@@ -12,6 +16,7 @@
 #include "spdlog/spdlog.h"
 
 #include "enums.h"
+#include "file.h"
 #include "fwd.h"
 
 namespace torrest { namespace bittorrent {
@@ -52,6 +57,14 @@ namespace torrest { namespace bittorrent {
         std::int64_t active_time;
         std::int64_t all_time_download;
         std::int64_t all_time_upload;
+        int deadline_hits;
+        int deadline_misses;
+        double deadline_hit_ratio;
+    };
+
+    struct DeadlinePiece {
+        std::chrono::steady_clock::time_point due;
+        int escalations;
     };
 
     class Torrent : public std::enable_shared_from_this<Torrent> {
@@ -65,6 +78,9 @@ namespace torrest { namespace bittorrent {
         Torrent(std::shared_ptr<ServiceSettings> pSettings,
                 libtorrent::torrent_handle pHandle,
                 std::string pInfoHash,
+                bool pDownload,
+                std::shared_ptr<StreamingPlugin> pPlugin,
+                std::shared_ptr<MemoryBuffer> pMemoryBuffer,
                 std::shared_ptr<spdlog::logger> pLogger);
 
         void pause();
@@ -77,9 +93,11 @@ namespace torrest { namespace bittorrent {
 
         void set_priority(libtorrent::download_priority_t pPriority);
 
+        int set_priority(libtorrent::download_priority_t pPriority, const std::string &pPrefix);
+
         void check_available_space(const std::string &pPath);
 
-        void check_save_resume_data() const;
+        bool check_save_resume_data();
 
         TorrentInfo get_info() const;
 
@@ -87,21 +105,39 @@ namespace torrest { namespace bittorrent {
 
         State get_state() const;
 
-        std::vector<std::shared_ptr<File>> get_files() const;
+        std::vector<FileInfo> get_files_info() const;
+
+        std::vector<FileStatus> get_files_status() const;
+
+        std::shared_ptr<File> get_file(int pIndex);
 
-        std::shared_ptr<File> get_file(int pIndex) const;
+        void prefetch_next_file(int pIndex);
+
+        void prefetch_companion_files(int pIndex);
 
         const std::string &get_info_hash() const {
             return mInfoHash;
         }
 
+        bool is_memory_storage() const {
+            return mMemoryBuffer != nullptr;
+        }
+
+        bool has_metadata() const {
+            return mHasMetadata.load();
+        }
+
     private:
+        void check_download_allowed(libtorrent::download_priority_t pPriority) const;
+
         void handle_metadata_received();
 
 #if !TORREST_LEGACY_READ_PIECE
 
         void store_piece(libtorrent::piece_index_t pPiece, int pSize, const boost::shared_array<char> &pBuffer);
 
+        void fail_piece(libtorrent::piece_index_t pPiece);
+
         void cleanup_pieces(const std::chrono::milliseconds &pExpiration);
 
         void schedule_read_piece(libtorrent::piece_index_t pPiece);
@@ -113,6 +149,7 @@ namespace torrest { namespace bittorrent {
                              const boost::optional<std::chrono::time_point<std::chrono::steady_clock>> &pWaitUntil);
 
         std::unordered_map<libtorrent::piece_index_t, PieceData> mPieces;
+        std::unordered_set<libtorrent::piece_index_t> mFailedPieces;
 
 #endif //TORREST_LEGACY_READ_PIECE
 
@@ -121,23 +158,91 @@ namespace torrest { namespace bittorrent {
 
         State get_torrent_state() const;
 
-        std::int64_t get_bytes_missing(const std::vector<libtorrent::piece_index_t> &pPieces) const;
+        std::shared_ptr<const FileTable> get_file_table() const;
+
+        std::vector<std::shared_ptr<File>> get_materialized_files() const;
+
+        void handle_piece_finished(libtorrent::piece_index_t pPiece);
+
+        void handle_block_finished(libtorrent::piece_index_t pPiece, int pBlock) const;
+
+        void handle_hash_failed(libtorrent::piece_index_t pPiece) const;
+
+        void invalidate_buffering_state() const;
 
         bool verify_buffering_state() const;
 
+        bool has_readers() const;
+
+        void set_bandwidth_class(BandwidthClass pClass, int pDownloadLimit, int pUploadLimit);
+
+        void set_stream_promotion(bool pPromote);
+
+        void set_sequential_download(bool pSequential);
+
+        void set_piece_deadline(libtorrent::piece_index_t pPiece, int pDeadline);
+
+        void set_deadline_window(const void *pOwner, int pStartPiece, int pEndPiece);
+
+        void set_deadline_windows(const void *pOwner, std::vector<std::pair<int, int>> pWindows);
+
+        void remove_deadline_windows(const void *pOwner);
+
+        bool is_in_deadline_window(int pPiece) const;
+
+        void drop_deadline_piece(libtorrent::piece_index_t pPiece);
+
+        void check_deadlines();
+
+        void record_deadline(const DeadlinePiece &pDeadlinePiece, const std::chrono::steady_clock::time_point &pNow);
+
+        void prefetch_ranges(const FileTable &pFileTable,
+                             const std::vector<std::pair<std::int64_t, std::int64_t>> &pRanges);
+
+        void update_read_position(int pIndex, std::int64_t pOffset, std::int64_t pSize);
+
+        void set_read_positions(std::map<int, std::int64_t> pPositions);
+
+        bool get_dirty_read_positions(std::map<int, std::int64_t> &pPositions);
+
+        void prewarm_read_positions(const FileTable &pFileTable);
+
         std::shared_ptr<spdlog::logger> mLogger;
         libtorrent::torrent_handle mHandle;
+        std::shared_ptr<StreamingPlugin> mPlugin;
+        std::shared_ptr<MemoryBuffer> mMemoryBuffer;
         std::shared_ptr<ServiceSettings> mSettings;
         std::string mInfoHash;
         std::string mDefaultName;
-        std::vector<std::shared_ptr<File>> mFiles;
+        std::shared_ptr<const FileTable> mFileTable;
+        std::unordered_map<int, std::shared_ptr<File>> mFiles;
+        std::unordered_map<int, DeadlinePiece> mDeadlinePieces;
+        std::unordered_map<const void *, std::vector<std::pair<int, int>>> mDeadlineWindows;
+        std::unordered_set<int> mPrefetchedFiles;
+        std::unordered_set<int> mCompanionsPrefetched;
+        std::map<int, std::int64_t> mReadPositions;
         mutable std::mutex mMutex;
         mutable std::mutex mFilesMutex;
         mutable std::mutex mPiecesMutex;
         mutable std::condition_variable mPiecesCv;
+        std::mutex mDeadlinesMutex;
+        std::mutex mReadPositionsMutex;
+        bool mReadPositionsDirty{};
         std::atomic<bool> mPaused{};
         std::atomic<bool> mHasMetadata;
         std::atomic<bool> mClosed;
+        std::atomic<bool> mResumeDataDirty{};
+        std::atomic<bool> mDownloadOnMetadata;
+        std::atomic<int> mReaders{};
+        std::atomic<int> mDeadlineHits{};
+        std::atomic<int> mDeadlineMisses{};
+        std::chrono::steady_clock::time_point mLastReannounce;
+        BandwidthClass mBandwidthClass;
+        int mDownloadLimit;
+        int mUploadLimit;
+        bool mStreamPromoted;
+        bool mSequentialDownload;
+        libtorrent::queue_position_t mQueuePosition;
     };
 
 }}
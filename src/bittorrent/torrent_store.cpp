@@ -0,0 +1,148 @@
+#include "torrent_store.h"
+
+#include <stdexcept>
+
+#include "boost/filesystem.hpp"
+
+#include "log_torrent_store.h"
+#include "utils/utils.h"
+
+#define EXT_TORRENT ".torrent"
+#define EXT_MAGNET ".magnet"
+#define EXT_FASTRESUME ".fastresume"
+#define EXT_READ_POSITIONS ".positions"
+#define LOG_STORE_FILE "torrents.log"
+
+namespace torrest { namespace bittorrent {
+
+    namespace {
+
+        const char *get_extension(TorrentRecordType pType) {
+            switch (pType) {
+                case tr_fast_resume:
+                    return EXT_FASTRESUME;
+                case tr_torrent:
+                    return EXT_TORRENT;
+                case tr_magnet:
+                    return EXT_MAGNET;
+                case tr_read_positions:
+                    return EXT_READ_POSITIONS;
+                default:
+                    throw std::invalid_argument("Invalid record type");
+            }
+        }
+
+        void migrate_records(TorrentStore &pFrom, TorrentStore &pTo, const std::shared_ptr<spdlog::logger> &pLogger) {
+            auto records = pFrom.load();
+            if (records.empty()) {
+                return;
+            }
+
+            pLogger->info("operation=migrate_records, message='Migrating torrent records', count={}", records.size());
+            for (auto &record : records) {
+                pTo.save(record.type, record.info_hash, [data = std::move(record.data)] { return data; });
+            }
+
+            // Only delete the old records once the new ones are persisted
+            pTo.flush();
+            for (auto &record : records) {
+                pFrom.remove(record.type, record.info_hash);
+            }
+            pFrom.flush();
+        }
+
+    }
+
+    FileTorrentStore::FileTorrentStore(std::shared_ptr<ServiceSettings> pSettings,
+                                       std::shared_ptr<PersistenceQueue> pPersistenceQueue,
+                                       std::shared_ptr<spdlog::logger> pLogger)
+            : mSettings(std::move(pSettings)),
+              mPersistenceQueue(std::move(pPersistenceQueue)),
+              mLogger(std::move(pLogger)) {}
+
+    void FileTorrentStore::save(TorrentRecordType pType, const std::string &pInfoHash, DataProvider pProvider) {
+        auto path = get_path(pType, pInfoHash);
+        mPersistenceQueue->enqueue(path, [path, provider = std::move(pProvider)] {
+            utils::write_file(path, provider());
+        });
+    }
+
+    void FileTorrentStore::remove(TorrentRecordType pType, const std::string &pInfoHash) {
+        auto path = get_path(pType, pInfoHash);
+        mPersistenceQueue->enqueue(path, [path] { boost::filesystem::remove(path); });
+    }
+
+    std::vector<char> FileTorrentStore::get(TorrentRecordType pType, const std::string &pInfoHash) {
+        return utils::read_file(get_path(pType, pInfoHash));
+    }
+
+    std::vector<TorrentRecord> FileTorrentStore::load() {
+        mLogger->debug("operation=load, message='Loading torrent files'");
+        std::vector<TorrentRecord> records;
+
+        for (auto &p : boost::filesystem::directory_iterator(mSettings->load()->torrents_path)) {
+            if (!boost::filesystem::is_regular_file(p.path())) {
+                continue;
+            }
+
+            auto ext = p.path().extension();
+            TorrentRecordType type;
+            if (ext == EXT_FASTRESUME) {
+                type = tr_fast_resume;
+            } else if (ext == EXT_TORRENT) {
+                type = tr_torrent;
+            } else if (ext == EXT_MAGNET) {
+                type = tr_magnet;
+            } else if (ext == EXT_READ_POSITIONS) {
+                type = tr_read_positions;
+            } else {
+                continue;
+            }
+
+            try {
+                records.push_back(TorrentRecord{type, p.path().stem().string(), utils::read_file(p.path().string())});
+            } catch (const std::exception &e) {
+                mLogger->error("operation=load, message='Failed reading torrent file', what='{}', file='{}'",
+                               e.what(), p.path().string());
+            }
+        }
+
+        return records;
+    }
+
+    void FileTorrentStore::flush() {
+        mPersistenceQueue->flush();
+    }
+
+    std::string FileTorrentStore::get_path(TorrentRecordType pType, const std::string &pInfoHash) const {
+        return utils::join_path(mSettings->load()->torrents_path, pInfoHash + get_extension(pType)).string();
+    }
+
+    std::shared_ptr<TorrentStore> open_torrent_store(const settings::Settings &pSettings,
+                                                     std::shared_ptr<ServiceSettings> pServiceSettings,
+                                                     std::shared_ptr<PersistenceQueue> pPersistenceQueue,
+                                                     std::shared_ptr<spdlog::logger> pLogger) {
+        auto logPath = utils::join_path(pSettings.torrents_path, LOG_STORE_FILE).string();
+
+        if (pSettings.log_structured_store) {
+            pLogger->debug("operation=open_torrent_store, message='Opening log store', path='{}'", logPath);
+            auto store = std::make_shared<LogTorrentStore>(logPath, pLogger);
+            FileTorrentStore fileStore(std::move(pServiceSettings), std::move(pPersistenceQueue), pLogger);
+            migrate_records(fileStore, *store, pLogger);
+            return store;
+        }
+
+        auto store = std::make_shared<FileTorrentStore>(
+                std::move(pServiceSettings), std::move(pPersistenceQueue), pLogger);
+        if (boost::filesystem::exists(logPath)) {
+            {
+                LogTorrentStore logStore(logPath, pLogger);
+                migrate_records(logStore, *store, pLogger);
+            }
+            boost::filesystem::remove(logPath);
+        }
+
+        return store;
+    }
+
+}}
@@ -0,0 +1,88 @@
+#ifndef TORREST_TORRENT_STORE_H
+#define TORREST_TORRENT_STORE_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "spdlog/spdlog.h"
+
+#include "persistence_queue.h"
+#include "settings.h"
+
+namespace torrest { namespace bittorrent {
+
+    enum TorrentRecordType : std::uint8_t {
+        tr_fast_resume,
+        tr_torrent,
+        tr_magnet,
+        tr_read_positions,
+        tr_num_values
+    };
+
+    struct TorrentRecord {
+        TorrentRecordType type;
+        std::string info_hash;
+        std::vector<char> data;
+    };
+
+    /**
+     * Persists the torrents metadata (fast resume data, torrent and magnet files and last read
+     * positions). Records are identified by their type and info hash. Writes are asynchronous
+     * and the record data is only produced when the write is executed, so that repeated saves
+     * are cheap.
+     */
+    class TorrentStore {
+    public:
+        typedef std::function<std::vector<char>()> DataProvider;
+
+        virtual ~TorrentStore() = default;
+
+        virtual void save(TorrentRecordType pType, const std::string &pInfoHash, DataProvider pProvider) = 0;
+
+        virtual void remove(TorrentRecordType pType, const std::string &pInfoHash) = 0;
+
+        virtual std::vector<char> get(TorrentRecordType pType, const std::string &pInfoHash) = 0;
+
+        virtual std::vector<TorrentRecord> load() = 0;
+
+        virtual void flush() = 0;
+    };
+
+    /**
+     * Stores each record in its own file inside the torrents path.
+     */
+    class FileTorrentStore : public TorrentStore {
+    public:
+        FileTorrentStore(std::shared_ptr<ServiceSettings> pSettings,
+                         std::shared_ptr<PersistenceQueue> pPersistenceQueue,
+                         std::shared_ptr<spdlog::logger> pLogger);
+
+        void save(TorrentRecordType pType, const std::string &pInfoHash, DataProvider pProvider) override;
+
+        void remove(TorrentRecordType pType, const std::string &pInfoHash) override;
+
+        std::vector<char> get(TorrentRecordType pType, const std::string &pInfoHash) override;
+
+        std::vector<TorrentRecord> load() override;
+
+        void flush() override;
+
+    private:
+        std::string get_path(TorrentRecordType pType, const std::string &pInfoHash) const;
+
+        std::shared_ptr<ServiceSettings> mSettings;
+        std::shared_ptr<PersistenceQueue> mPersistenceQueue;
+        std::shared_ptr<spdlog::logger> mLogger;
+    };
+
+    std::shared_ptr<TorrentStore> open_torrent_store(const settings::Settings &pSettings,
+                                                     std::shared_ptr<ServiceSettings> pServiceSettings,
+                                                     std::shared_ptr<PersistenceQueue> pPersistenceQueue,
+                                                     std::shared_ptr<spdlog::logger> pLogger);
+
+}}
+
+#endif //TORREST_TORRENT_STORE_H
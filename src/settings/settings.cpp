@@ -65,12 +65,15 @@ namespace torrest { namespace settings {
             torrents_path,
             user_agent,
             session_save,
+            log_structured_store,
             tuned_storage,
             check_available_space,
             connections_limit,
             limit_after_buffering,
             max_download_rate,
             max_upload_rate,
+            max_background_rate,
+            max_seeding_rate,
             share_ratio_limit,
             seed_time_ratio_limit,
             seed_time_limit,
@@ -81,12 +84,16 @@ namespace torrest { namespace settings {
             active_tracker_limit,
             active_lsd_limit,
             active_limit,
+            lazy_activation,
 #if TORRENT_ABI_VERSION > 2
             write_mode,
 #endif
             encryption_policy,
             proxy,
             buffer_size,
+            sequential_window,
+            prefetch_next_file,
+            memory_storage_size,
             piece_wait_timeout,
 #if !TORREST_LEGACY_READ_PIECE
             piece_expiration,
@@ -125,6 +132,8 @@ namespace torrest { namespace settings {
         VALIDATE(session_save, GT(0));
         VALIDATE(max_download_rate, GTE(0));
         VALIDATE(max_upload_rate, GTE(0));
+        VALIDATE(max_background_rate, GTE(0));
+        VALIDATE(max_seeding_rate, GTE(0));
         VALIDATE(share_ratio_limit, GTE(0));
         VALIDATE(seed_time_ratio_limit, GTE(0));
         VALIDATE(seed_time_limit, GTE(0));
@@ -132,6 +141,9 @@ namespace torrest { namespace settings {
         VALIDATE(write_mode, GTE(0), LT(wm_num_values));
 #endif
         VALIDATE(encryption_policy, GTE(0), LT(ep_num_values));
+        VALIDATE(sequential_window, GTE(0));
+        VALIDATE(prefetch_next_file, GTE(0), LTE(100));
+        VALIDATE(memory_storage_size, GTE(0));
         VALIDATE(piece_wait_timeout, GTE(0));
 #if !TORREST_LEGACY_READ_PIECE
         VALIDATE(piece_expiration, GT(0));
@@ -56,12 +56,15 @@ namespace torrest { namespace settings {
         std::string torrents_path = "downloads/torrents";
         std::string user_agent;
         int session_save = 30;
+        bool log_structured_store = false;
         bool tuned_storage = false;
         bool check_available_space = true;
         int connections_limit = 0;
         bool limit_after_buffering = false;
         int max_download_rate = 0;
         int max_upload_rate = 0;
+        int max_background_rate = 0;
+        int max_seeding_rate = 0;
         int share_ratio_limit = 0;
         int seed_time_ratio_limit = 0;
         int seed_time_limit = 0;
@@ -72,12 +75,16 @@ namespace torrest { namespace settings {
         int active_tracker_limit = 1600;
         int active_lsd_limit = 60;
         int active_limit = 500;
+        bool lazy_activation = false;
 #if TORRENT_ABI_VERSION > 2
         WriteMode write_mode = wm_auto;
 #endif
         EncryptionPolicy encryption_policy = ep_enabled;
         std::shared_ptr<ProxySettings> proxy = nullptr;
         std::int64_t buffer_size = 20 * 1024 * 1024;
+        std::int64_t sequential_window = 0;
+        int prefetch_next_file = 80;
+        std::int64_t memory_storage_size = 0;
         int piece_wait_timeout = 60;
 #if !TORREST_LEGACY_READ_PIECE
         int piece_expiration = 5;
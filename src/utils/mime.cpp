@@ -2,6 +2,9 @@
 
 #include <map>
 
+#include "boost/algorithm/string.hpp"
+#include "boost/filesystem.hpp"
+
 namespace torrest { namespace utils {
 
     std::map<std::string, std::string> &get_mimes() {
@@ -997,9 +1000,19 @@ namespace torrest { namespace utils {
     }
 
     std::string guess_mime_type(const std::string &pExtension) {
-        auto mimes = get_mimes();
+        auto &mimes = get_mimes();
         auto it = mimes.find(pExtension);
         return it == mimes.end() ? "application/octet-stream" : it->second;
     }
 
+    bool is_video_file(const std::string &pFileName) {
+        auto extension = boost::algorithm::to_lower_copy(boost::filesystem::path(pFileName).extension().string());
+        return guess_mime_type(extension).compare(0, 6, "video/") == 0;
+    }
+
+    bool is_audio_file(const std::string &pFileName) {
+        auto extension = boost::algorithm::to_lower_copy(boost::filesystem::path(pFileName).extension().string());
+        return guess_mime_type(extension).compare(0, 6, "audio/") == 0;
+    }
+
 }}
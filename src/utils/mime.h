@@ -7,6 +7,10 @@ namespace torrest { namespace utils {
 
     std::string guess_mime_type(const std::string &pExtension);
 
+    bool is_video_file(const std::string &pFileName);
+
+    bool is_audio_file(const std::string &pFileName);
+
 }}
 
 #endif //TORREST_MIME_H
@@ -1,5 +1,7 @@
 #include "utils.h"
 
+#include <cctype>
+#include <fstream>
 #include <stdexcept>
 
 namespace torrest { namespace utils {
@@ -80,4 +82,57 @@ namespace torrest { namespace utils {
         return ret;
     }
 
+    std::vector<char> read_file(const std::string &pPath) {
+        std::ifstream ifs(pPath, std::ios::binary | std::ios::ate);
+        if (!ifs) {
+            throw std::runtime_error("Unable to open file");
+        }
+
+        std::vector<char> buffer(static_cast<std::size_t>(ifs.tellg()));
+        ifs.seekg(0, std::ios::beg);
+        ifs.read(buffer.data(), std::streamsize(buffer.size()));
+        return buffer;
+    }
+
+    void write_file(const std::string &pPath, const std::vector<char> &pBuffer) {
+        std::ofstream of(pPath, std::ios::binary);
+        of.unsetf(std::ios::skipws);
+        of.write(pBuffer.data(), std::streamsize(pBuffer.size()));
+    }
+
+    bool natural_less(const std::string &pA, const std::string &pB) {
+        std::size_t i = 0;
+        std::size_t j = 0;
+
+        while (i < pA.length() && j < pB.length()) {
+            if (std::isdigit(static_cast<unsigned char>(pA[i])) && std::isdigit(static_cast<unsigned char>(pB[j]))) {
+                // Compare numbers by value, ignoring leading zeros
+                while (i < pA.length() && pA[i] == '0') { i++; }
+                while (j < pB.length() && pB[j] == '0') { j++; }
+                auto endA = i;
+                auto endB = j;
+                while (endA < pA.length() && std::isdigit(static_cast<unsigned char>(pA[endA]))) { endA++; }
+                while (endB < pB.length() && std::isdigit(static_cast<unsigned char>(pB[endB]))) { endB++; }
+
+                if (endA - i != endB - j) {
+                    return endA - i < endB - j;
+                }
+                auto cmp = pA.compare(i, endA - i, pB, j, endB - j);
+                if (cmp != 0) {
+                    return cmp < 0;
+                }
+                i = endA;
+                j = endB;
+            } else {
+                auto a = std::tolower(static_cast<unsigned char>(pA[i++]));
+                auto b = std::tolower(static_cast<unsigned char>(pB[j++]));
+                if (a != b) {
+                    return a < b;
+                }
+            }
+        }
+
+        return pA.length() - i < pB.length() - j;
+    }
+
 }}
\ No newline at end of file
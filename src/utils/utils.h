@@ -34,6 +34,12 @@ namespace torrest { namespace utils {
 
     std::string unescape_string(const std::string &pStr);
 
+    std::vector<char> read_file(const std::string &pPath);
+
+    void write_file(const std::string &pPath, const std::vector<char> &pBuffer);
+
+    bool natural_less(const std::string &pA, const std::string &pB);
+
     inline std::string &ltrim(std::string &pStr, const char *pChars = " \t\n\r\f\v") {
         pStr.erase(0, pStr.find_first_not_of(pChars));
         return pStr;